@@ -1,59 +1,155 @@
 #define SDL_MAIN_HANDLED
 #include <iostream>
 #include <cstring>
+#include <initializer_list>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <bit>
+#include <cmath>
 #include <SDL.h>
+#include "KOBZ_CHIP8PLUS.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>    // VirtualAlloc for the JIT, file mapping for --record
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
+// Emulation thread -> audio callback: what the sound timer, pattern buffer and pitch say to play.
+// Written under SDL_LockAudioDevice, and only when it changes
+struct AUDIO_T {
+    SDL_AudioDeviceID device;
+    uint32_t frequency;         // Device samples per second
+    bool on;                    // Sound timer running and the machine not paused
+    uint8_t pattern[16];        // As CHIP_8::audio_pattern
+    uint8_t pitch;              // As CHIP_8::pitch
+    double position;            // Callback: pattern sample the next output sample falls on, 0 to 128
+};
+
 class SDL_T {
     public:
         SDL_Window *window;     // Window
         SDL_Renderer *renderer; // Renderer
+        SDL_Texture *texture;   // Streaming framebuffer, window_width x window_height texels
+        AUDIO_T *audio;         // Sound output, nullptr when no audio device could be opened
 };
 
-enum EXTENSION_T {
-    CHIP8,
+// Window thread -> emulation thread input, single producer / single consumer
+#define INPUT_QUEUE_SIZE 256 // Power of two
+
+enum INPUT_T : uint8_t {
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_PAUSE,        // Toggle pause
+    INPUT_TURBO,        // Toggle fast-forward
+    INPUT_SAVE_STATE,   // Write the save state file
+    INPUT_LOAD_STATE,   // Restore the save state file
+    INPUT_REWIND,       // Rewind held (key 1) or released (key 0)
+    INPUT_QUIT,
 };
 
-struct CONFIG_T {
-    uint32_t window_width;      // Width of the SDL window
-    uint32_t window_height;     // Height of the SDL window
-    uint32_t fg_color;          // Foreground color in RGBA8888 format
-    uint32_t bg_color;          // Background color in RGBA8888 format
-    uint32_t scale_factor;      // Scaling factor for CHIP-8 pixel size
-    uint32_t clock_rate;        // CHIP-8 CPU Clock Rate (in Layman's Terms, number of mHz or speed)
-    EXTENSION_T current_ex;
+struct INPUT_EVENT_T {
+    INPUT_T type;
+    uint8_t key;        // Keypad value for INPUT_KEY_DOWN/INPUT_KEY_UP
 };
 
-enum EMULATOR_STATE_T {
-    QUIT,       // State indicating the program should quit
-    RUNNING,    // State indicating the emulator is running
-    PAUSED,     // State indicating the emulator is paused
+struct INPUT_QUEUE_T {
+    INPUT_EVENT_T events[INPUT_QUEUE_SIZE];
+    atomic<uint32_t> head;      // Next slot to write, owned by the window thread
+    atomic<uint32_t> tail;      // Next slot to read, owned by the emulation thread
 };
 
-struct INSTRUCTION_T {
-    uint16_t opcode;
-    uint16_t NNN;    // 12-bit address
-    uint8_t NN;     // 8-bit address
-    uint8_t N;     // 4-bit address
-    uint8_t X;    // 4-bit register identifier
-    uint8_t Y;   // 4-bit register identifier
-};
+// Queue an event; dropped if the emulation thread is INPUT_QUEUE_SIZE events behind
+bool input_push(INPUT_QUEUE_T *input, const INPUT_EVENT_T event) {
+    const uint32_t head = input->head.load(memory_order_relaxed);
+    if (head - input->tail.load(memory_order_acquire) == INPUT_QUEUE_SIZE) return false;
+    input->events[head & (INPUT_QUEUE_SIZE - 1)] = event;
+    input->head.store(head + 1, memory_order_release);
+    return true;
+}
+
+bool input_pop(INPUT_QUEUE_T *input, INPUT_EVENT_T *event) {
+    const uint32_t tail = input->tail.load(memory_order_relaxed);
+    if (tail == input->head.load(memory_order_acquire)) return false;
+    *event = input->events[tail & (INPUT_QUEUE_SIZE - 1)];
+    input->tail.store(tail + 1, memory_order_release);
+    return true;
+}
 
-struct CHIP_8 {
-    EMULATOR_STATE_T state;     // Current state of the CHIP-8 machine
-    uint8_t ram[4096];          // Random Access Memory
-    bool display[64 * 32];      // CHIP-8 pixels
-    uint16_t stack[12];         // Subroutine stack (12 16-bytes)
-    uint16_t *stack_ptr;        // Subroutine stack pointer
-    uint8_t V[16];              // Data Registers V0-VF (16 8-bytes)
-    uint16_t I;                 // Index Register
-    uint16_t PC;                // Program Counter
-    uint8_t delay_timer;        // Decrements at 60 hz when > 0
-    bool keypad[16];            // Hexadecimal keypad 0x0-0xF
-    const char *rom_name;       // Running ROM
-    INSTRUCTION_T inst;         // Executing Instruction
+// Emulation thread -> window thread frames. The emulation thread always owns back and the window
+// thread front; finished frames are swapped through middle, so neither side ever waits on the other
+// and the window always gets the newest complete frame
+#define FRAME_FRESH 0x4 // middle holds a frame the window thread hasn't taken yet
+
+struct FRAMEBUFFER_T {
+    DISPLAY_ROW_T display[3][DISPLAY_PLANES][DISPLAY_HEIGHT];
+    uint32_t planes;            // Bitplanes copied per frame, display_planes of the quirk set
+    bool hires[3];              // Resolution each buffer's frame was drawn at
+    uint64_t damage[3];         // Rows each buffer's frame changed since a frame the window has taken
+    uint64_t carry;             // Emulation thread: damage of the last published frame, in case the window drops it
+    atomic<uint8_t> middle;     // Buffer index | FRAME_FRESH
+    uint8_t back;               // Being written by the emulation thread
+    uint8_t front;              // Being drawn by the window thread
+    atomic<uint32_t> speed;     // Emulated speed in hundredths of real time while fast-forwarding, 0 otherwise
+    atomic<bool> stopped;       // The emulation thread has left its loop, e.g. at --max-frames
 };
 
+void framebuffer_init(FRAMEBUFFER_T *framebuffer, const uint32_t planes) {
+    framebuffer->planes = planes;
+    framebuffer->back = 0;
+    framebuffer->middle.store(1, memory_order_relaxed);
+    framebuffer->front = 2;
+}
+
+// Publish a finished frame with the rows changed since the window last took one
+void framebuffer_publish(FRAMEBUFFER_T *framebuffer, CHIP_8 *chip8) {
+    // Only a frame still waiting in middle can be dropped; once the window has taken it only this frame's rows changed.
+    // FRAME_FRESH is only ever set here, so if it is clear now it stays clear until the exchange below
+    const bool pending = framebuffer->middle.load(memory_order_acquire) & FRAME_FRESH;
+    const uint64_t damage = chip8->damage | (pending ? framebuffer->carry : 0);
+    memcpy(framebuffer->display[framebuffer->back], chip8->display, framebuffer->planes * sizeof chip8->display[0]);
+    framebuffer->hires[framebuffer->back] = chip8->hires;
+    framebuffer->damage[framebuffer->back] = damage;
+    const uint8_t previous = framebuffer->middle.exchange(framebuffer->back | FRAME_FRESH, memory_order_acq_rel);
+    // If this frame is dropped in turn, the next one must repaint everything it covered
+    framebuffer->carry = damage;
+    framebuffer->back = previous & 3;
+    chip8->damage = 0;
+}
+
+// Take the newest published frame into front, with the rows it changed since the previous call's
+// frame. False (and no damage) if nothing new since the last call; front keeps the frame it had
+bool framebuffer_acquire(FRAMEBUFFER_T *framebuffer, uint64_t *damage) {
+    *damage = 0;
+    if (!(framebuffer->middle.load(memory_order_relaxed) & FRAME_FRESH)) return false;
+    framebuffer->front = framebuffer->middle.exchange(framebuffer->front, memory_order_acq_rel) & 3;
+    *damage = framebuffer->damage[framebuffer->front];
+    return true;
+}
+
+// Audio thread: loop the pattern's one-bit samples at the pitch's rate while the sound timer runs
+void audio_callback(void *userdata, Uint8 *stream, const int length) {
+    AUDIO_T *audio = (AUDIO_T *)userdata;
+    int16_t *samples = (int16_t *)stream;
+    const int count = length / (int)sizeof *samples;
+    if (!audio->on) {
+        memset(stream, 0, length);
+        return; }
+
+    const double step = 4000.0 * pow(2.0, (audio->pitch - 64) / 48.0) / audio->frequency;
+    for (int i = 0; i < count; i++) {
+        const uint32_t bit = (uint32_t)audio->position;
+        samples[i] = (audio->pattern[bit / 8] >> (7 - bit % 8)) & 1 ? 3000 : -3000;
+        audio->position += step;
+        if (audio->position >= 128) audio->position -= 128;
+    }
+}
+
 // Initialize SDL
 bool INIT(SDL_T *sdl, const CONFIG_T config) {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0) { // Initialize SDL subsystems for video, audio, and timer
@@ -70,10 +166,43 @@ bool INIT(SDL_T *sdl, const CONFIG_T config) {
     sdl->renderer = SDL_CreateRenderer(sdl->window, -1, SDL_RENDERER_ACCELERATED); // Create SDL renderer for hardware acceleration
     if (!sdl->renderer) {
         SDL_Log("Could not create SDL renderer %s\n", SDL_GetError());
+        return false; }
+
+    // RGBA8888 texels are 0xRRGGBBAA words, the same layout as fg_color/bg_color
+    sdl->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                     config.window_width, config.window_height);
+    if (!sdl->texture) {
+        SDL_Log("Could not create SDL texture %s\n", SDL_GetError());
         return false;
+    }
+    SDL_SetTextureBlendMode(sdl->texture, SDL_BLENDMODE_NONE); // Colors replace the window's, as the old fills did
+
+    // Sound is simply off without an audio device
+    AUDIO_T *audio = (AUDIO_T *)calloc(1, sizeof(AUDIO_T));
+    const SDL_AudioSpec want = {.freq = 44100, .format = AUDIO_S16SYS, .channels = 1, .samples = 512,
+                                .callback = audio_callback, .userdata = audio};
+    SDL_AudioSpec have = {};
+    if (audio && (audio->device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0)) != 0) {
+        audio->frequency = have.freq;
+        sdl->audio = audio;
+        SDL_PauseAudioDevice(audio->device, 0); // Silence until the sound timer runs
+    } else {
+        SDL_Log("Could not open SDL audio device %s, running without sound\n", SDL_GetError());
+        free(audio);
     } return true;
 }
 
+// Sound output for the emulation thread's current machine state; locks the device only on a change
+void audio_update(AUDIO_T *audio, const CHIP_8 *chip8, const bool on) {
+    if (!audio || (audio->on == on && (!on || (audio->pitch == chip8->pitch &&
+                   memcmp(audio->pattern, chip8->audio_pattern, sizeof audio->pattern) == 0)))) return;
+    SDL_LockAudioDevice(audio->device);
+    audio->on = on;
+    audio->pitch = chip8->pitch;
+    memcpy(audio->pattern, chip8->audio_pattern, sizeof audio->pattern);
+    SDL_UnlockAudioDevice(audio->device);
+}
+
 // Set up default emulator configurations from passed in arguments
 bool set_config_from_args(CONFIG_T *config, int argc, const char **argv) {
     // Set default configurations
@@ -82,23 +211,178 @@ bool set_config_from_args(CONFIG_T *config, int argc, const char **argv) {
             .window_height = 32,                // CHIP-8 Y resolution
             .fg_color = 0xFFFFFFFF,             // WHITE
             .bg_color = 0x000000FF,             // BLACK
+            .palette = {0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF, // Black, white, greys, then saturated colors
+                        0xFF0000FF, 0x00FF00FF, 0x0000FFFF, 0xFFFF00FF,
+                        0x880000FF, 0x008800FF, 0x000088FF, 0x888800FF,
+                        0xFF00FFFF, 0x00FFFFFF, 0x880088FF, 0x008888FF},
             .scale_factor = 15,                 // Default resolution will be 1280 X 640
             .clock_rate = 750,                  // .75 mHz -> 750,000 instructions are computed (or emulated in this case) per second
+            .refresh_rate = 60,                 // Frames handed to the window per second
             .current_ex = CHIP8,                // Behaves as CHIP-8 system
+#if defined(CHIP8_AOT)
+            .engine = ENGINE_AOT,               // This build carries the ROM precompiled
+#elif defined(CHIP8_HAS_COMPUTED_GOTO)
+            .engine = ENGINE_THREADED,          // Fastest dispatch this compiler supports
+#else
+            .engine = ENGINE_SWITCH,
+#endif
+            .profile_path = nullptr,            // Not profiling
+            .record_path = nullptr,             // Not recording
+            .record_capacity = 1 << 20,         // 16 MiB trace ring
+            .until_pc = -1,                     // No PC breakpoint
+            .seed = CHIP8_RNG_SEED,             // Same CXNN sequence every run
     };
 
     // Override defaults from passed-in arguments
+    bool scaled = false;
     for (int i = 1; i < argc; i++) {
         (void)argv[i]; // Prevent compiler error from unused variables argc/argv
         if (strncmp(argv[i], "--scale-factor", strlen("--scale-factor")) == 0) {
             i++;
             config->scale_factor = (uint32_t)strtol(argv[i], nullptr, 10);
+            scaled = true;
+        } else if (strncmp(argv[i], "--quirks", strlen("--quirks")) == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "chip8") == 0) {
+                config->current_ex = CHIP8;
+            } else if (strcmp(argv[i], "superchip") == 0) {
+                config->current_ex = SUPERCHIP;
+            } else if (strcmp(argv[i], "xochip") == 0) {
+                config->current_ex = XOCHIP;
+            } else {
+                SDL_Log("Unknown quirk set %s (expected chip8, superchip or xochip)", argv[i]);
+                return false;
+            }
+        } else if (strncmp(argv[i], "--engine", strlen("--engine")) == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "switch") == 0) {
+                config->engine = ENGINE_SWITCH;
+            } else if (strcmp(argv[i], "threaded") == 0) {
+#ifdef CHIP8_HAS_COMPUTED_GOTO
+                config->engine = ENGINE_THREADED;
+#else
+                SDL_Log("Threaded engine needs GCC/Clang computed goto, using switch engine");
+#endif
+            } else if (strcmp(argv[i], "jit") == 0) {
+#ifdef CHIP8_HAS_JIT
+                config->engine = ENGINE_JIT;
+#else
+                SDL_Log("JIT engine needs an x86-64 host, using default engine");
+#endif
+            } else if (strcmp(argv[i], "aot") == 0) {
+#ifdef CHIP8_AOT
+                config->engine = ENGINE_AOT;
+#else
+                SDL_Log("AOT engine needs a build generated with chip8-aot, using default engine");
+#endif
+            } else {
+                SDL_Log("Unknown engine %s (expected switch, threaded, jit or aot)", argv[i]);
+                return false;
+            }
+        } else if (strncmp(argv[i], "--clock-rate", strlen("--clock-rate")) == 0 && i + 1 < argc) {
+            i++;
+            config->clock_rate = (uint32_t)strtoul(argv[i], nullptr, 10);
+            if (config->clock_rate == 0) {
+                SDL_Log("Clock rate must be at least 1 instruction per second");
+                return false;
+            }
+        } else if (strncmp(argv[i], "--turbo", strlen("--turbo")) == 0) {
+            config->turbo = true;
+        } else if (strncmp(argv[i], "--refresh-rate", strlen("--refresh-rate")) == 0 && i + 1 < argc) {
+            i++;
+            config->refresh_rate = (uint32_t)strtoul(argv[i], nullptr, 10);
+            if (config->refresh_rate == 0) {
+                SDL_Log("Refresh rate must be at least 1 frame per second");
+                return false;
+            }
+        } else if (strncmp(argv[i], "--profile", strlen("--profile")) == 0 && i + 1 < argc) {
+            i++;
+            config->profile_path = argv[i];
+        } else if (strncmp(argv[i], "--record-capacity", strlen("--record-capacity")) == 0 && i + 1 < argc) {
+            i++;
+            config->record_capacity = (uint32_t)strtoul(argv[i], nullptr, 10);
+            if (config->record_capacity == 0) {
+                SDL_Log("Record capacity must be at least 1 instruction");
+                return false;
+            }
+        } else if (strncmp(argv[i], "--record", strlen("--record")) == 0 && i + 1 < argc) {
+            i++;
+            config->record_path = argv[i];
+        } else if (strncmp(argv[i], "--headless", strlen("--headless")) == 0) {
+            config->headless = true;
+        } else if (strncmp(argv[i], "--max-instructions", strlen("--max-instructions")) == 0 && i + 1 < argc) {
+            i++;
+            config->max_instructions = strtoull(argv[i], nullptr, 10);
+        } else if (strncmp(argv[i], "--max-frames", strlen("--max-frames")) == 0 && i + 1 < argc) {
+            i++;
+            config->max_frames = strtoull(argv[i], nullptr, 10);
+        } else if (strncmp(argv[i], "--until-pc", strlen("--until-pc")) == 0 && i + 1 < argc) {
+            i++;
+            config->until_pc = (int32_t)strtol(argv[i], nullptr, 16);
+            if (config->until_pc < 0 || config->until_pc >= RAM_SIZE) {
+                SDL_Log("PC %s is outside XO-CHIP memory", argv[i]);
+                return false;
+            }
+        } else if (strncmp(argv[i], "--until-hash", strlen("--until-hash")) == 0 && i + 1 < argc) {
+            i++;
+            config->has_until_hash = true;
+            config->until_hash = strtoull(argv[i], nullptr, 16);
+        } else if (strncmp(argv[i], "--state", strlen("--state")) == 0 && i + 1 < argc) {
+            i++;
+            config->state_path = argv[i];
+        } else if (strncmp(argv[i], "--load-state", strlen("--load-state")) == 0 && i + 1 < argc) {
+            i++;
+            config->load_state_path = argv[i];
+        } else if (strncmp(argv[i], "--save-state", strlen("--save-state")) == 0 && i + 1 < argc) {
+            i++;
+            config->save_state_path = argv[i];
+        } else if (strncmp(argv[i], "--movie-record", strlen("--movie-record")) == 0 && i + 1 < argc) {
+            i++;
+            config->movie_record_path = argv[i];
+        } else if (strncmp(argv[i], "--movie-play", strlen("--movie-play")) == 0 && i + 1 < argc) {
+            i++;
+            config->movie_play_path = argv[i];
+        } else if (strncmp(argv[i], "--seed", strlen("--seed")) == 0 && i + 1 < argc) {
+            i++;
+            config->seed = (uint32_t)strtoul(argv[i], nullptr, 16);
+            if (config->seed == 0) {
+                SDL_Log("Seed must be nonzero");
+                return false;
+            }
+        } else if (strncmp(argv[i], "--dump-pbm", strlen("--dump-pbm")) == 0 && i + 1 < argc) {
+            i++;
+            config->pbm_path = argv[i];
+        } else if (strncmp(argv[i], "--dump", strlen("--dump")) == 0 && i + 1 < argc) {
+            i++;
+            config->dump_path = argv[i];
         }
+    }
+
+    if (config->current_ex != XOCHIP && config->until_pc > 0xFFF) {
+        SDL_Log("PC %03X is outside CHIP-8 memory", config->until_pc);
+        return false;
+    }
+    if (config->current_ex == SUPERCHIP || config->current_ex == XOCHIP) {
+        // Window and texture at hi-res, lo-res pixels drawn 2x2; half the scale keeps the default window about as big
+        config->window_width = DISPLAY_WIDTH;
+        config->window_height = DISPLAY_HEIGHT;
+        if (!scaled) config->scale_factor = 8;
+    }
+    if (config->movie_record_path && config->movie_play_path) {
+        SDL_Log("--movie-record and --movie-play can't be used together");
+        return false;
+    }
+    if (config->headless && !config->max_instructions && !config->max_frames && config->until_pc < 0 && !config->has_until_hash &&
+        !config->movie_play_path) {
+        SDL_Log("--headless needs an exit condition (--max-instructions, --max-frames, --until-pc, --until-hash or --movie-play)");
+        return false;
     } return true;
 }
 
-// Initialize CHIP-8 machine
-bool init_chip8(CHIP_8 *chip8, const char rom_name[]) {
+#define BIG_FONT_ADDRESS 0x50 // FX30 digits, right after the CHIP-8 font
+
+// Initialize CHIP-8 machine with the memory of quirk set ex
+bool init_chip8(CHIP_8 *chip8, const char rom_name[], const EXTENSION_T ex) {
     const uint32_t entry_point = 0x200; // CHIP-8 ROM loaded to 0x200
     const uint8_t font[] = {
             0xF0, 0x90, 0x90, 0x90, 0xF0,   // 0
@@ -118,8 +402,36 @@ bool init_chip8(CHIP_8 *chip8, const char rom_name[]) {
             0xF0, 0x80, 0xF0, 0x80, 0xF0,   // E
             0xF0, 0x80, 0xF0, 0x80, 0x80,   // F
     };
+    const uint8_t big_font[] = {        // SUPER-CHIP FX30 digits, 8x10
+            0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,   // 0
+            0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,   // 1
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,   // 2
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,   // 3
+            0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,   // 4
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,   // 5
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,   // 6
+            0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,   // 7
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,   // 8
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,   // 9
+            0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,   // A
+            0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,   // B
+            0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,   // C
+            0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,   // D
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,   // E
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0,   // F
+    };
+
+    // Memory and its decode cache are sized by the quirk set: 4 KB, or 64 KB under XO-CHIP
+    const uint32_t size = memory_size(ex);
+    chip8->extension = ex;
+    chip8->ram = (uint8_t *)calloc(size, sizeof *chip8->ram);
+    chip8->decode_cache = (DECODED_T *)calloc(size, sizeof *chip8->decode_cache);
+    if (!chip8->ram || !chip8->decode_cache) {
+        SDL_Log("Could not allocate %u bytes of CHIP-8 memory", size);
+        return false; }
 
     memcpy(&chip8->ram[0], font, sizeof(font)); // Load font into RAM
+    memcpy(&chip8->ram[BIG_FONT_ADDRESS], big_font, sizeof(big_font));
 
     FILE *rom = fopen(rom_name, "rb");
     if (!rom) {
@@ -129,7 +441,7 @@ bool init_chip8(CHIP_8 *chip8, const char rom_name[]) {
     // Get/check ROM size
     fseek(rom, 0, SEEK_END);
     const long rom_size = ftell(rom);
-    const long max_size = sizeof chip8->ram - entry_point;
+    const long max_size = size - entry_point; // 0xE00 bytes, unless XO-CHIP
     rewind(rom);
 
     if (rom_size > max_size) {
@@ -148,12 +460,20 @@ bool init_chip8(CHIP_8 *chip8, const char rom_name[]) {
     chip8->PC = entry_point; // Start program counter at ROM's entry point
     chip8->rom_name = rom_name;
     chip8->stack_ptr = &chip8->stack[0];
+    chip8->rng = CHIP8_RNG_SEED; // Same CXNN sequence every run, as with the unseeded rand() before
+    chip8->damage = DAMAGE_ALL;  // The window has drawn nothing yet
+    chip8->planes = 1;           // XO-CHIP draws into plane 0 until FN01
+    chip8->pitch = 64;           // 4000 samples per second: the default pattern's 500 Hz square wave
+    memset(chip8->audio_pattern, 0xF0, sizeof chip8->audio_pattern);
 
     return true;
 }
 
 // Clean up SDL resources
 void final_cleanup(const SDL_T sdl) {
+    if (sdl.audio) SDL_CloseAudioDevice(sdl.audio->device); // Stops the callback before its state goes
+    free(sdl.audio);
+    SDL_DestroyTexture(sdl.texture);     // Destroy framebuffer texture
     SDL_DestroyRenderer(sdl.renderer);   // Destroy SDL renderer
     SDL_DestroyWindow(sdl.window);       // Destroy SDL window
     SDL_Quit();                          // Quit SDL subsystems
@@ -174,485 +494,3061 @@ void clear_screen(const CONFIG_T config, const SDL_T sdl) {
     SDL_RenderClear(sdl.renderer); // Clear the renderer
 }
 
-// Update the screen
-void update_screen(const SDL_T sdl, const CONFIG_T config, const CHIP_8 chip8) {
-    SDL_Rect rect = {.x = 0, .y = 0, .w = static_cast<int>(config.scale_factor), .h = static_cast<int>(config.scale_factor)};
-
-    // Obtain colors to draw
-    const uint8_t fg_r = (config.fg_color >> 24) & 0xFF; // Right-shift by 24 and mask using 255 for red fg
-    const uint8_t fg_g = (config.fg_color >> 16) & 0xFF; // Right-shift by 16 and mask using 255 for green fg
-    const uint8_t fg_b = (config.fg_color >> 8) & 0xFF;  // Right-shift by 8 and mask using 255 for blue fg
-    const uint8_t fg_a = (config.fg_color >> 0) & 0xFF;  // Right-shift by 0 and mask using 255 for alpha fg
-
-    const uint8_t bg_r = (config.bg_color >> 24) & 0xFF; // Right-shift by 24 and mask using 255 for red fg
-    const uint8_t bg_g = (config.bg_color >> 16) & 0xFF; // Right-shift by 16 and mask using 255 for green fg
-    const uint8_t bg_b = (config.bg_color >> 8) & 0xFF; // Right-shift by 8 and mask using 255 for blue fg
-    const uint8_t bg_a = (config.bg_color >> 0) & 0xFF; // Right-shift by 0 and mask using 255 for alpha fg
-
-    // Loop through display pixels, draw rectangle per pixel to SDL window
-    for (uint32_t i = 0; i < sizeof chip8.display; i++) {
-        // Translate 1D index i value to 2D X/Y coordinates
-        // X = i % window width
-        // Y = i / window width
-        rect.x = (i % config.window_width) * config.scale_factor;
-        rect.y = (i / config.window_width) * config.scale_factor;
-
-        if (chip8.display[i]) {
-            // If pixel on, draw foreg color
-            SDL_SetRenderDrawColor(sdl.renderer, fg_r, fg_g, fg_b, fg_a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
-        } else {
-            // If pixel off, draw backg color
-            SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
+// Update the screen: expand the damaged rows into the streaming texture, then draw it scaled to the
+// whole window with one copy. Rows outside damage keep the texels of earlier frames. A pixel covers
+// as many texels as the texture is larger than the display mode: 2x2 for lo-res on a hi-res texture.
+// One plane is drawn in fg_color/bg_color, several through palette
+void update_screen(const SDL_T sdl, const CONFIG_T config, const DISPLAY_ROW_T (*display)[DISPLAY_HEIGHT], const uint32_t planes,
+                   const bool hires, const uint64_t damage) {
+    const uint32_t width = hires ? DISPLAY_WIDTH : LORES_WIDTH, height = hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    uint64_t rows = height < 64 ? damage & ((1ull << height) - 1) : damage;
+    while (rows) {
+        // One lock per run of adjacent damaged rows
+        const uint32_t first = countr_zero(rows);
+        const uint32_t count = countr_one(rows >> first);
+        rows &= first + count < 64 ? ~0ull << (first + count) : 0;
+
+        const uint32_t top = first * config.window_height / height, bottom = (first + count) * config.window_height / height;
+        if (top == bottom) continue;
+        const SDL_Rect rect = {.x = 0, .y = (int)top, .w = (int)config.window_width, .h = (int)(bottom - top)};
+        void *pixels;
+        int pitch;
+        if (SDL_LockTexture(sdl.texture, &rect, &pixels, &pitch) != 0) {
+            SDL_Log("Could not lock SDL texture %s\n", SDL_GetError());
+            return; }
+        for (uint32_t row = top; row < bottom; row++) {
+            const uint32_t y = row * height / config.window_height;
+            uint32_t *texel = (uint32_t *)((uint8_t *)pixels + (row - top) * pitch);
+            if (planes == 1) {
+                for (uint32_t x = 0; x < config.window_width; x++)
+                    texel[x] = display_pixel(display[0], x * width / config.window_width, y) ? config.fg_color : config.bg_color;
+                continue; }
+            for (uint32_t x = 0; x < config.window_width; x++) {
+                uint32_t color = 0;
+                for (uint32_t p = 0; p < planes; p++) color |= display_pixel(display[p], x * width / config.window_width, y) << p;
+                texel[x] = config.palette[color];
+            }
         }
+        SDL_UnlockTexture(sdl.texture);
     }
 
+    SDL_RenderCopy(sdl.renderer, sdl.texture, nullptr, nullptr); // Scaled by scale_factor, the window's size
     SDL_RenderPresent(sdl.renderer); // Present the renderer to the window
 }
 
-void update_timers(CHIP_8 *chip8) { if (chip8->delay_timer > 0) chip8->delay_timer--; }
+void update_timers(CHIP_8 *chip8) {
+    if (chip8->delay_timer > 0) chip8->delay_timer--;
+    if (chip8->sound_timer > 0) chip8->sound_timer--;
+    if (chip8->movie) movie_frame(chip8);
+}
+
+// CHIP-8 keypad value for a QWERTY key, -1 if the key isn't mapped
+int keypad_key(const SDL_Keycode key) {
+    switch (key) {
+        case SDLK_1: return 0x1; // 1 -> 1
+        case SDLK_2: return 0x2; // 2 -> 2
+        case SDLK_3: return 0x3; // 3 -> 3
+        case SDLK_4: return 0xC; // C -> 4
+
+        case SDLK_q: return 0x4; // 4 -> q
+        case SDLK_w: return 0x5; // 5 -> w
+        case SDLK_e: return 0x6; // 6 -> e
+        case SDLK_r: return 0xD; // D -> r
+
+        case SDLK_a: return 0x7; // 7 -> a
+        case SDLK_s: return 0x8; // 8 -> s
+        case SDLK_d: return 0x9; // 9 -> d
+        case SDLK_f: return 0xE; // E -> f
+
+        case SDLK_z: return 0xA; // A -> z
+        case SDLK_x: return 0x0; // 0 -> x
+        case SDLK_c: return 0xB; // B -> c
+        case SDLK_v: return 0xF; // F -> v
+
+        default: return -1;
+    }
+}
 
-// Handle user input events
-void handle_input(CHIP_8 *chip8) {
+// Handle user input events on the window thread, forwarding them to the emulation thread.
+// Returns false once the user has asked to quit
+bool handle_input(INPUT_QUEUE_T *input, bool *exposed) {
     SDL_Event event;
+    bool running = true;
 
     // Poll SDL events
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
             case SDL_QUIT:
                 // Exit window; End program
-                chip8->state = QUIT; // Will exit main emulator loop
+                input_push(input, {INPUT_QUIT, 0});
+                running = false;
                 break;
 
             case SDL_KEYDOWN:
-                switch (event.key.keysym.sym) {
-                    case SDLK_ESCAPE:
-                        // Escape key; Exit window; End program
-                        chip8->state = QUIT;
-                        break;
-
-                    case SDLK_SPACE:
-                        // Space bar
-                        if (chip8->state == RUNNING) {
-                            chip8->state = PAUSED;  // Pause
-                            SDL_Log("==== PAUSED ====");
-                        } else {
-                            chip8->state = RUNNING; // Resume
-                        } break;
-
-                    // Map qwerty keys to CHIP8 keypad
-                    case SDLK_1: chip8->keypad[0x1] = true; break; // 1 -> 1
-                    case SDLK_2: chip8->keypad[0x2] = true; break; // 2 -> 2
-                    case SDLK_3: chip8->keypad[0x3] = true; break; // 3 -> 3
-                    case SDLK_4: chip8->keypad[0xC] = true; break; // C -> 4
-
-                    case SDLK_q: chip8->keypad[0x4] = true; break; // 4 -> q
-                    case SDLK_w: chip8->keypad[0x5] = true; break; // 5 -> w
-                    case SDLK_e: chip8->keypad[0x6] = true; break; // 6 -> e
-                    case SDLK_r: chip8->keypad[0xD] = true; break; // D -> r
-
-                    case SDLK_a: chip8->keypad[0x7] = true; break; // 7 -> a
-                    case SDLK_s: chip8->keypad[0x8] = true; break; // 8 -> s
-                    case SDLK_d: chip8->keypad[0x9] = true; break; // 9 -> d
-                    case SDLK_f: chip8->keypad[0xE] = true; break; // E -> f
-
-                    case SDLK_z: chip8->keypad[0xA] = true; break; // A -> z
-                    case SDLK_x: chip8->keypad[0x0] = true; break; // 0 -> x
-                    case SDLK_c: chip8->keypad[0xB] = true; break; // B -> c
-                    case SDLK_v: chip8->keypad[0xF] = true; break; // F -> v
-
-                    default: break;
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    // Escape key; Exit window; End program
+                    input_push(input, {INPUT_QUIT, 0});
+                    running = false;
+                } else if (event.key.keysym.sym == SDLK_SPACE) {
+                    input_push(input, {INPUT_PAUSE, 0}); // Space bar
+                } else if (event.key.keysym.sym == SDLK_TAB) {
+                    input_push(input, {INPUT_TURBO, 0}); // Tab; toggle fast-forward
+                } else if (event.key.keysym.sym == SDLK_F5) {
+                    input_push(input, {INPUT_SAVE_STATE, 0});
+                } else if (event.key.keysym.sym == SDLK_F9) {
+                    input_push(input, {INPUT_LOAD_STATE, 0});
+                } else if (event.key.keysym.sym == SDLK_BACKSPACE) {
+                    input_push(input, {INPUT_REWIND, 1}); // Backspace; rewind while held
+                } else if (keypad_key(event.key.keysym.sym) >= 0) {
+                    input_push(input, {INPUT_KEY_DOWN, (uint8_t)keypad_key(event.key.keysym.sym)});
                 } break;
 
+            case SDL_WINDOWEVENT:
+                // Window contents lost or rescaled: present the current frame again
+                if (event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                    *exposed = true;
+                break;
+
             case SDL_KEYUP:
-                switch (event.key.keysym.sym) {
-                    // Map qwerty keys to CHIP8 keypad
-                    case SDLK_1: chip8->keypad[0x1] = false; break; // 1 -> 1
-                    case SDLK_2: chip8->keypad[0x2] = false; break; // 2 -> 2
-                    case SDLK_3: chip8->keypad[0x3] = false; break; // 3 -> 3
-                    case SDLK_4: chip8->keypad[0xC] = false; break; // C -> 4
-
-                    case SDLK_q: chip8->keypad[0x4] = false; break; // 4 -> q
-                    case SDLK_w: chip8->keypad[0x5] = false; break; // 5 -> w
-                    case SDLK_e: chip8->keypad[0x6] = false; break; // 6 -> e
-                    case SDLK_r: chip8->keypad[0xD] = false; break; // D -> r
-
-                    case SDLK_a: chip8->keypad[0x7] = false; break; // 7 -> a
-                    case SDLK_s: chip8->keypad[0x8] = false; break; // 8 -> s
-                    case SDLK_d: chip8->keypad[0x9] = false; break; // 9 -> d
-                    case SDLK_f: chip8->keypad[0xE] = false; break; // E -> f
-
-                    case SDLK_z: chip8->keypad[0xA] = false; break; // A -> z
-                    case SDLK_x: chip8->keypad[0x0] = false; break; // 0 -> x
-                    case SDLK_c: chip8->keypad[0xB] = false; break; // B -> c
-                    case SDLK_v: chip8->keypad[0xF] = false; break; // F -> v
-
-                    default: break;
-                } break;
+                if (event.key.keysym.sym == SDLK_BACKSPACE)
+                    input_push(input, {INPUT_REWIND, 0});
+                else if (keypad_key(event.key.keysym.sym) >= 0)
+                    input_push(input, {INPUT_KEY_UP, (uint8_t)keypad_key(event.key.keysym.sym)});
+                break;
 
             default: break;
         }
-    }
+    } return running;
 }
 
-// Emulate CHIP-8 instruction
-void emulate_instructions(CHIP_8 *chip8, const CONFIG_T config) {
-    bool carry; // Carry flag
-    uint8_t X_coord;
-    uint8_t Y_coord;
-    uint8_t orig_X;
-
-    // Fetch the next 16-bit opcode from memory (RAM) by combining the higher 8 bits from the current address with the lower 8 bits from the next address
-    chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | chip8->ram[chip8->PC + 1];
-    chip8->PC += 2; // Pre-increment program counter for next opcode
+// Apply an input event to the machine on the emulation thread
+void apply_input(CHIP_8 *chip8, const CONFIG_T &config, const INPUT_EVENT_T event) {
+    char state_path[1024];
+    if (event.type == INPUT_SAVE_STATE || event.type == INPUT_LOAD_STATE) {
+        if (config.state_path) snprintf(state_path, sizeof state_path, "%s", config.state_path);
+        else snprintf(state_path, sizeof state_path, "%s.state", chip8->rom_name);
+    }
 
-    chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;// Extract the lowest 12 bits of opcode and store in NNN (High-Bit)
-    chip8->inst.NN = chip8->inst.opcode & 0x0FF; // Extract the lowest 8 bits of opcode and store in NN (Middle-Bit)
-    chip8->inst.N = chip8->inst.opcode & 0x0F;  // Extract the lowest 4 bits of opcode and store in N (Low-Bit)
-    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F; // Right shift opcode by 8 positions, then extract the lowest 4 bits and store in X
-    chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F; // Right shift opcode by 4 positions, then extract the lowest 4 bits and store in Y
-
-    // Emulate opcode
-    switch ((chip8->inst.opcode >> 12) & 0x0F) { // Extract 4 LSB and mask with 15
-        case 0x00:
-            if (chip8->inst.NN == 0xE0) {
-                memset(&chip8->display[0], false, sizeof chip8->display);
-                SDL_Log("0x00E0: Cleared Screen");
-            } else if (chip8->inst.NN == 0xEE) {
-                // 0x00EE: Return from subroutine
-                // Grab last address from subroutine stack ("pop")
-                // so that the next opcode will be obtained from address
-                chip8->PC = *--chip8->stack_ptr; // Obtain address from stack and assign to program counter
-                SDL_Log("0x00EE: Return from subroutine. PC set to %04X", chip8->PC);
+    switch (event.type) {
+        case INPUT_KEY_DOWN: case INPUT_KEY_UP:
+            if (movie_key(chip8, event.key, event.type == INPUT_KEY_DOWN)) chip8->keypad[event.key] = event.type == INPUT_KEY_DOWN;
+            break;
+        case INPUT_PAUSE:
+            if (chip8->state == RUNNING) {
+                chip8->state = PAUSED;  // Pause
+                SDL_Log("==== PAUSED ====");
             } else {
-                SDL_Log("0x00: Invalid opcode. Ignoring instruction."); // Invalid opcode
+                chip8->state = RUNNING; // Resume
             } break;
-        case 0x01:
-            // 0x1NNN: Jump to address NNN
-            SDL_Log("Before jump. PC: %04X", chip8->PC);
-            chip8->PC = chip8->inst.NNN; // Set program counter so that the next opcode is from NNN
-            SDL_Log("0x01: Jump to address NNN. PC set to %04X", chip8->PC);
-            break;
-        case 0x02:
-            // 0x2NNN: Call subroutine at NNN
-            // Store current address to return to on subroutine stack ("push")
-            // and set program counter to subroutine address so that the next opcode is gotten from there
-            SDL_Log("Stack pointer before push: %p", (void*)chip8->stack_ptr);
-            *chip8->stack_ptr++ = chip8->PC; // Save current program counter on stack; increment stack pointer
-            SDL_Log("Stack pointer after push: %p", (void*)chip8->stack_ptr);
-            chip8->PC = chip8->inst.NNN; // Extract 12-bit and assign to program counter
-            SDL_Log("0x02: Call subroutine at NNN. PC set to %04X", chip8->PC);
-            break;
-        case 0x03:
-            // 0x3XNN: Check if VX == NN, if so, skip next instruction
-            if (chip8->V[chip8->inst.X] == chip8->inst.NN) {
-                chip8->PC += 2; // Skips instruction
-                SDL_Log("0x03: Skip next instruction. VX[%X] == NN(%X)", chip8->inst.X, chip8->inst.NN);
-            } break;
-        case 0x04:
-            // 0x4XNN: Check if VX != NN, if so, skip next instruction
-            if (chip8->V[chip8->inst.X] != chip8->inst.NN) {
-                chip8->PC += 2; // Skips instruction
-                SDL_Log("0x04: Skip next instruction. VX[%X] != NN(%X)", chip8->inst.X, chip8->inst.NN);
-            } break;
-        case 0x05:
-            // 0x5XY0: Check if VX == VY, if so, skip next instruction
-            if (chip8->inst.N != 0) {
-                SDL_Log("0x05: Invalid opcode. Ignoring instruction.");
-                break;
-            } if (chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y]) {
-                chip8->PC += 2;
-                SDL_Log("0x05: Skip next instruction. VX[%X] == VY[%X]", chip8->inst.X, chip8->inst.Y);
-            } break;
-        case 0x06:
-            // 0x6XNN: Set register VX to NN
-            chip8->V[chip8->inst.X] = chip8->inst.NN;
-            SDL_Log("0x06: Set VX[%X] to NN(%X)", chip8->inst.X, chip8->inst.NN);
-            break;
-        case 0x07:
-            // 0x7XNN: Set register VX += NN
-            chip8->V[chip8->inst.X] += chip8->inst.NN;
-            SDL_Log("0x07: Add NN(%X) to VX[%X]", chip8->inst.NN, chip8->inst.X);
-            break;
-        case 0x08:
-            switch (chip8->inst.N) {
-                case 0:
-                    // 0x8XY0: Assignment (VX, VY)
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
-                    SDL_Log("0x08XY0: VX[%X] = VY[%X]", chip8->inst.X, chip8->inst.Y);
-                    break;
-                case 1:
-                    // 0x8XY1: Set register VX |= VY
-                    chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
-                    if (config.current_ex == CHIP8)
-                        chip8->V[0xF] = 0;  // Reset VF to 0
-                    SDL_Log("DEBUG: Executed 0x8XY1 instruction. V[%X] = V[%X] | V[%X]", chip8->inst.X, chip8->inst.X, chip8->inst.Y);
-                    break;
-
-                case 2:
-                    // 0x8XY2: Set register VX &= VY
-                    chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
-                    if (config.current_ex == CHIP8)
-                        chip8->V[0xF] = 0;  // Reset VF to 0
-                    SDL_Log("DEBUG: Executed 0x8XY2 instruction. V[%X] = V[%X] & V[%X]", chip8->inst.X, chip8->inst.X, chip8->inst.Y);
-                    break;
-
-                case 3:
-                    // 0x8XY3: Set register VX ^= VY
-                    chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
-                    if (config.current_ex == CHIP8)
-                        chip8->V[0xF] = 0;  // Reset VF to 0
-                    SDL_Log("DEBUG: Executed 0x8XY3 instruction. V[%X] = V[%X] ^ V[%X]", chip8->inst.X, chip8->inst.X, chip8->inst.Y);
-                    break;
-                case 4:
-                    // 0x08XY4: Bitwise ADD_CARRY (VX, VY) 1 if carry 0 if not
-                    carry = ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255);
-                    chip8->V[chip8->inst.X] += chip8->V[chip8->inst.Y];
-                    chip8->V[0xF] = carry; // Set last data register to carry
-                    SDL_Log("0x08XY4: VX[%X] += VY[%X]. Carry: %d", chip8->inst.X, chip8->inst.Y, carry);
-                    break;
-                case 5:
-                    // 0x08XY5: Bitwise SUBTRACT_BORROW (VX - VY) 1 if not borrow 0 if borrow
-                    carry = (chip8->V[chip8->inst.Y] <= chip8->V[chip8->inst.X]); // Check for borrow
-                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
-                    chip8->V[0xF] = carry; // Set last data register to carry
-                    SDL_Log("0x08XY5: VX[%X] -= VY[%X]. Borrow: %d", chip8->inst.X, chip8->inst.Y, !carry);
-                    break;
-                case 6:
-                    // 0x08XY6: Set register VX >>= 1, store shifted off bit in carry
-                    if (config.current_ex == CHIP8) {
-                        carry = chip8->V[chip8->inst.Y] & 1;    // Use VY
-                        chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1; // Set VX = VY result
-                    } else {
-                        carry = chip8->V[chip8->inst.X] & 1;    // Use VX
-                        chip8->V[chip8->inst.X] >>= 1;          // Use VX
-                    }
-                    chip8->V[0xF] = carry; // Set last data register to carry
-                    SDL_Log("DEBUG: Executed 0x8%X (SHR V%X, V%X) instruction. Shifted VX >>= 1. VF = %d", chip8->inst.opcode & 0x00FF, chip8->inst.X, chip8->inst.Y, chip8->V[0xF]);
-                    break;
-                case 7:
-                    // 0x08XY7: Bitwise SUBTRACT_BORROW (VY - VX) 1 if not borrow 0 if borrow
-                    carry = (chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y]); // Check for borrow
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
-                    chip8->V[0xF] = carry; // Set last data register to carry
-                    SDL_Log("0x08XY7: VX[%X] = VY[%X] - VX[%X]. Borrow: %d", chip8->inst.X, chip8->inst.Y, chip8->inst.X, !carry);
-                    break;
-                case 0xE:
-                    // 0x08XYE: Set register VX <<= 1, store shifted off bit in carry
-                    if (config.current_ex == CHIP8) {
-                        carry = (chip8->V[chip8->inst.Y] & 0x80) >> 7;  // Use VY
-                        chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] << 1; // Set VX = VY result
-                    } else {
-                        carry = (chip8->V[chip8->inst.X] & 0x80) >> 7;  // VX
-                        chip8->V[chip8->inst.X] <<= 1;                  // Use VX
-                    }
-                    chip8->V[0xF] = carry; // Set last data register to carry
-                    SDL_Log("DEBUG: Executed 0x8%X (SHL V%X, V%X) instruction. Shifted VX <<= 1. VF = %d", chip8->inst.opcode & 0x00FF, chip8->inst.X, chip8->inst.Y, chip8->V[0xF]);
-                    break;
-                default: break; // Invalid opcode
-            }
+        case INPUT_TURBO: case INPUT_REWIND: break; // Pacing, handled by emulation_thread
+        case INPUT_SAVE_STATE:
+            if (write_state_file(state_path, chip8)) SDL_Log("State saved to %s", state_path);
             break;
-        case 0x09:
-            // 0x09XY0: Check if VX != VY; Skip next instruction if so
-            if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y])
-                chip8->PC += 2;
+        case INPUT_LOAD_STATE:
+            if (chip8->movie) SDL_Log("Loading a state would break the movie");
+            else if (read_state_file(state_path, chip8)) SDL_Log("State loaded from %s", state_path);
             break;
-        case 0x0A:
-            // 0x0ANNN: Set index register I to NNN
-            chip8->I = chip8->inst.NNN;
-            SDL_Log("0x0ANNN: I set to %04X", chip8->I);
+        case INPUT_QUIT: chip8->state = QUIT; break; // Will exit the emulation loop
+    }
+}
+
+// Window title, with the fast-forward multiplier while it is on
+void update_title(const SDL_T &sdl, const uint32_t speed) {
+    char title[64];
+    if (speed) snprintf(title, sizeof title, "CHIP-8 Emulator (%.1fx)", speed / 100.0);
+    else snprintf(title, sizeof title, "CHIP-8 Emulator");
+    SDL_SetWindowTitle(sdl.window, title);
+}
+
+#ifdef CHIP8_AOT
+// Drop precompiled blocks overlapping a RAM write; the interpreter takes over those addresses
+void aot_invalidate(AOT_T *aot, const uint32_t address, const uint32_t length) {
+    const uint32_t first = address > AOT_MAX_BLOCK_BYTES ? address - AOT_MAX_BLOCK_BYTES : 0;
+    for (uint32_t start = first; start < address + length && start < aot->memory_size; start++) {
+        const AOT_BLOCK_T *block = aot->blocks[start];
+        if (block && start + block->bytes > address) aot->blocks[start] = nullptr;
+    }
+}
+#endif
+
+#if CHIP8_TRACE_LEVEL > TRACE_LEVEL_OFF
+// Trace events travel through a bounded lock-free queue (per-slot sequence numbers, so any number
+// of emulator threads can push) and are formatted by one writer thread off the hot path.
+// When the writer falls behind, events are dropped and counted rather than stalling emulation
+#define TRACE_RING_SIZE 65536 // Power of two
+
+struct TRACE_SLOT_T {
+    atomic<uint32_t> seq;
+    TRACE_RECORD_T record;
+};
+
+static TRACE_SLOT_T trace_ring[TRACE_RING_SIZE];
+static atomic<uint32_t> trace_head;     // Next slot to write
+static atomic<uint32_t> trace_tail;     // Next slot to read, owned by the writer thread
+static atomic<uint32_t> trace_dropped;
+static atomic<bool> trace_running;
+static thread trace_writer;
+
+void trace_push(const char *fmt, const uint32_t *args, const size_t count) {
+    uint32_t pos = trace_head.load(memory_order_relaxed);
+    TRACE_SLOT_T *slot;
+    for (;;) {
+        slot = &trace_ring[pos & (TRACE_RING_SIZE - 1)];
+        const int32_t diff = (int32_t)(slot->seq.load(memory_order_acquire) - pos);
+        if (diff == 0 && trace_head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+        if (diff < 0) { // Full
+            trace_dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        if (diff > 0) pos = trace_head.load(memory_order_relaxed);
+    }
+    slot->record.fmt = fmt;
+    memcpy(slot->record.args, args, count * sizeof *args);
+    slot->seq.store(pos + 1, memory_order_release);
+}
+
+// Format everything queued so far; false if there was nothing
+static bool trace_drain(void) {
+    bool any = false;
+    for (uint32_t pos = trace_tail.load(memory_order_relaxed);; pos++) {
+        TRACE_SLOT_T *slot = &trace_ring[pos & (TRACE_RING_SIZE - 1)];
+        if (slot->seq.load(memory_order_acquire) != pos + 1) {
+            trace_tail.store(pos, memory_order_relaxed);
             break;
-        case 0x0B:
-            // 0x0BNNN: Jump to V0 + NNN
-            chip8->PC = chip8->V[0] + chip8->inst.NNN; // Set program counter to sum of the first data register and the 12-bit address
-            SDL_Log("0x0BNNN: Jump to V0 + NNN. PC set to %04X", chip8->PC);
+        }
+        const TRACE_RECORD_T &record = slot->record;
+        SDL_Log(record.fmt, record.args[0], record.args[1], record.args[2], record.args[3]);
+        slot->seq.store(pos + TRACE_RING_SIZE, memory_order_release); // Hand the slot back to producers
+        any = true;
+    }
+    const uint32_t dropped = trace_dropped.exchange(0, memory_order_relaxed);
+    if (dropped) SDL_Log("Trace: %u events dropped, writer fell behind", dropped);
+    return any;
+}
+
+// Start the writer thread
+void trace_start(void) {
+    for (uint32_t i = 0; i < TRACE_RING_SIZE; i++) trace_ring[i].seq.store(i, memory_order_relaxed);
+    trace_head.store(0, memory_order_relaxed);
+    trace_tail.store(0, memory_order_relaxed);
+    trace_running.store(true, memory_order_release);
+    trace_writer = thread([] {
+        while (trace_running.load(memory_order_acquire))
+            if (!trace_drain()) this_thread::sleep_for(chrono::milliseconds(1));
+        trace_drain(); // Flush what was pushed before trace_stop()
+    });
+}
+
+// Stop the writer thread after it has written every queued event
+void trace_stop(void) {
+    if (!trace_writer.joinable()) return;
+    trace_running.store(false, memory_order_release);
+    trace_writer.join();
+}
+#endif
+
+// Drop pre-decoded entries overlapping a RAM write so self-modifying ROMs get re-decoded
+void invalidate_decode_cache(CHIP_8 *chip8, uint32_t address, const uint32_t length) {
+    if (length == 0) return;
+    const uint32_t size = memory_size(chip8->extension);
+    address &= size - 1;
+    if (address + length > size) { // I-relative writes wrap past the end of memory: two spans
+        invalidate_decode_cache(chip8, address, size - address);
+        invalidate_decode_cache(chip8, 0, address + length - size);
+        return;
+    }
+    // Opcode at address - 1 also reads the first written byte, a fused pair at address - 3 covers it too
+    for (uint32_t addr = address > 3 ? address - 3 : 0; addr < address + length; addr++)
+        chip8->decode_cache[addr].handler = nullptr;
+#ifdef CHIP8_HAS_JIT
+    if (chip8->jit) jit_invalidate(chip8->jit, address, length);
+#endif
+#ifdef CHIP8_AOT
+    if (chip8->aot) aot_invalidate(chip8->aot, address, length);
+#endif
+}
+
+// Length in instructions of the idle loop whose head is at PC, 0 if PC doesn't start one.
+// Recognised loops only read the delay timer, which can't change inside a run_instructions batch:
+//   1NNN jumping to itself
+//   FX07; 3XNN; 1NNN back to the FX07 (spin until the delay timer reaches NN)
+uint32_t idle_loop_length(const CHIP_8 *chip8, const uint16_t PC) {
+    if (PC > memory_size(chip8->extension) - 6) return 0;
+    const uint8_t *op = &chip8->ram[PC];
+    const uint8_t X = op[0] & 0x0F;
+
+    if ((op[0] >> 4) == 0x1 && ((X << 8) | op[1]) == PC) return 1;
+    if ((op[0] >> 4) == 0xF && op[1] == 0x07 && op[2] == (0x30 | X) &&
+        (op[4] >> 4) == 0x1 && (((op[4] & 0x0F) << 8) | op[5]) == PC) return 3;
+    return 0;
+}
+
+// Fast-forward whole iterations of the idle loop at PC through the rest of the batch.
+// Final state is what running them one by one would leave; any partial iteration still runs normally
+void skip_idle_loop(CHIP_8 *chip8) {
+    switch (idle_loop_length(chip8, chip8->PC)) {
+        case 1:
+            chip8->cycles = 0; // Jump to self: nothing changes until the next batch
             break;
-        case 0x0C:
-            // 0x0CNNN: Sets register VX = rand() % 256 & NN (Bitwise AND)
-            chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
-            SDL_Log("0x0CNNN: VX[%X] = rand() %% 256 & NN(%X)", chip8->inst.X, chip8->inst.NN);
+        case 3: {
+            const uint8_t X = chip8->ram[chip8->PC] & 0x0F;
+            const uint8_t NN = chip8->ram[chip8->PC + 3];
+            if (chip8->delay_timer == NN || chip8->cycles < 3) break; // Loop exits this iteration
+            chip8->V[X] = chip8->delay_timer;                         // What every skipped FX07 stores
+            chip8->cycles %= 3;
             break;
-        case 0x0D:
-            // 0x0DXYN: Draw N-height sprite at coords X, Y; read from memory location I
-            // Screen pixels are XOR'd with sprite bits,
-            // VF (Carry Flag) is set if any screen pixels are set off; useful for collision detection
-            X_coord = chip8->V[chip8->inst.X] % config.window_width;
-            Y_coord = chip8->V[chip8->inst.Y] % config.window_height;
-            orig_X = X_coord; // Store original X coordinate
+        }
+        default: break;
+    }
+}
+
+// Bitplanes drawing, clearing and scrolling act on: FN01's selection under XO-CHIP, plane 0 otherwise
+template <typename QUIRKS>
+static inline uint32_t selected_planes(const CHIP_8 *chip8) {
+    if constexpr (QUIRKS::xochip) return chip8->planes;
+    return 1;
+}
+
+// Address a PC- or I-relative access lands on: memory wraps at the quirk set's size
+template <typename QUIRKS>
+static inline uint32_t ram_address(const uint32_t address) {
+    return address & (QUIRKS::memory_size - 1);
+}
 
-            chip8->V[0xF] = 0; // Initialize carry flag to 0
+// Bytes a skip jumps over from PC: XO-CHIP skips the whole of a 4-byte F000 NNNN
+template <typename QUIRKS>
+static inline uint16_t skip_length(const CHIP_8 *chip8) {
+    if constexpr (QUIRKS::xochip)
+        if (chip8->ram[chip8->PC] == 0xF0 && chip8->ram[ram_address<QUIRKS>(chip8->PC + 1)] == 0x00) return 4;
+    return 2;
+}
 
-            // Loop over all N rows of sprite
-            for (uint8_t i = 0; i < chip8->inst.N; i++) {
-                const uint8_t sprite_data = chip8->ram[chip8->I + i]; // Get next byte/row of sprite data
-                X_coord = orig_X; // Reset X for next row to draw
+// 0x00E0: Clear screen (XO-CHIP: the selected planes)
+template <typename QUIRKS>
+void op_00E0(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    const uint32_t planes = selected_planes<QUIRKS>(chip8);
+    for (uint32_t p = 0; p < QUIRKS::planes; p++)
+        if (planes >> p & 1) memset(chip8->display[p], 0, sizeof chip8->display[p]);
+    chip8->damage = DAMAGE_ALL;
+    TRACE_DEBUG("0x00E0: Cleared Screen");
+}
 
-                // Loop over each individual pixel in the sprite row
-                for (int8_t j = 7; j >= 0; j--) {
-                    // Get a pointer to the display pixel at the current (X, Y) coordinates
-                    bool *pixel = &chip8->display[Y_coord * config.window_width + X_coord];
+// 0x00EE: Return from subroutine
+template <typename QUIRKS>
+void op_00EE(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // Grab last address from subroutine stack ("pop")
+    // so that the next opcode will be obtained from address
+    chip8->PC = *--chip8->stack_ptr; // Obtain address from stack and assign to program counter
+    TRACE_DEBUG("0x00EE: Return from subroutine. PC set to %04X", chip8->PC);
+}
 
-                    const bool sprite_bit = (sprite_data & (1 << j)); // Extract the j-th bit (pixel) from the sprite data
+// 0x00CN: Scroll the display down N rows (SUPER-CHIP); rows are whole words, so this is one move per plane
+template <typename QUIRKS>
+void op_00CN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    const uint32_t height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    const uint32_t N = chip8->inst.N < height ? chip8->inst.N : height;
+    const uint32_t planes = selected_planes<QUIRKS>(chip8);
+    for (uint32_t p = 0; p < QUIRKS::planes; p++) {
+        if (!(planes >> p & 1)) continue;
+        DISPLAY_ROW_T *display = chip8->display[p];
+        memmove(&display[N], &display[0], (height - N) * sizeof display[0]);
+        memset(&display[0], 0, N * sizeof display[0]);
+    }
+    chip8->damage = DAMAGE_ALL;
+    TRACE_DEBUG("0x00CN: Scrolled down %d rows", N);
+}
 
-                    if (sprite_bit && *pixel) {
-                        chip8->V[0xF] = 1;
-                    } // If both the sprite bit and the display pixel are set (both on), set the carry flag (VF) (last data register) to 1
+// 0x00DN: Scroll the display up N rows (XO-CHIP)
+template <typename QUIRKS>
+void op_00DN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::xochip) return op_invalid<QUIRKS>(chip8, config);
+    const uint32_t height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    const uint32_t N = chip8->inst.N < height ? chip8->inst.N : height;
+    const uint32_t planes = selected_planes<QUIRKS>(chip8);
+    for (uint32_t p = 0; p < QUIRKS::planes; p++) {
+        if (!(planes >> p & 1)) continue;
+        DISPLAY_ROW_T *display = chip8->display[p];
+        memmove(&display[0], &display[N], (height - N) * sizeof display[0]);
+        memset(&display[height - N], 0, N * sizeof display[0]);
+    }
+    chip8->damage = DAMAGE_ALL;
+    TRACE_DEBUG("0x00DN: Scrolled up %d rows", N);
+}
 
-                    *pixel ^= sprite_bit; // XOR the display pixel with the sprite bit
+// 0x00FB: Scroll the display right 4 pixels (SUPER-CHIP). Lo-res rows are one word, so the shift
+// drops what leaves the right edge; hi-res carries the low nibble of the first word into the second
+template <typename QUIRKS>
+void op_00FB(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    const uint32_t height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    const uint32_t planes = selected_planes<QUIRKS>(chip8);
+    for (uint32_t p = 0; p < QUIRKS::planes; p++) {
+        if (!(planes >> p & 1)) continue;
+        for (uint32_t y = 0; y < height; y++) {
+            uint64_t *row = chip8->display[p][y];
+            if (chip8->hires) row[1] = row[1] >> 4 | row[0] << 60;
+            row[0] >>= 4;
+        }
+    }
+    chip8->damage = DAMAGE_ALL;
+    TRACE_DEBUG("0x00FB: Scrolled right 4 pixels");
+}
 
-                    if (++X_coord >= config.window_width) break; // Stop drawing if hit right edge of the screen
-                } if (++Y_coord >= config.window_height) break; // Stop drawing entire sprite if hit bottom edge of the screen
+// 0x00FC: Scroll the display left 4 pixels (SUPER-CHIP)
+template <typename QUIRKS>
+void op_00FC(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    const uint32_t height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    const uint32_t planes = selected_planes<QUIRKS>(chip8);
+    for (uint32_t p = 0; p < QUIRKS::planes; p++) {
+        if (!(planes >> p & 1)) continue;
+        for (uint32_t y = 0; y < height; y++) {
+            uint64_t *row = chip8->display[p][y];
+            row[0] <<= 4;
+            if (chip8->hires) {
+                row[0] |= row[1] >> 60;
+                row[1] <<= 4;
             }
-            SDL_Log("0x0DXYN: Draw sprite. VF(Carry): %d", chip8->V[0xF]);
-            SDL_Log("Program Counter after 0x0DXYN: 0x%04X", chip8->PC);
-            break;
-        case 0x0E:
-            if (chip8->inst.NN == 0x9E) {
-                // 0x0EX9E: Skip next instruction if key in VX pressed
-                if (chip8->keypad[chip8->V[chip8->inst.X]]) {
-                    chip8->PC += 2;
-                    SDL_Log("0x0EX9E: Skip next instruction. Key in V[%d] is pressed", chip8->inst.X);
-                }
-            } else if (chip8->inst.NN == 0xA1) {
-                // 0x0EXA1: Skip next instruction if key in VX not pressed
-                if (!chip8->keypad[chip8->V[chip8->inst.X]]) {
-                    chip8->PC += 2;
-                    SDL_Log("0x0EXA1: Skip next instruction. Key in V[%d] is not pressed", chip8->inst.X);
-                }
-            } break;
-        case 0x0F:
-            switch (chip8->inst.NN) {
-                case 0x0A: {
-                    // 0xFX0A: VX = get_key(); await until a keypress, and store in VX
-                    static bool anykey_pressed = false;
-                    static uint8_t key = 0xFF;
-
-                    for (uint8_t i = 0; key == 0xFF && i < sizeof chip8->keypad; i++) {
-                        if (chip8->keypad[i]) {
-                            chip8->V[chip8->inst.X] = i; // i = key offset for keypad array
-                            anykey_pressed = true;
-                        }
-                    } if (!anykey_pressed) { // If no key pressed, keep getting the current opcode & running instruction
-                        chip8->PC -= 2;
-                        SDL_Log("0xFX0A: Waiting for key press. PC decremented to %04X", chip8->PC);
-                    } else {
-                        if (chip8->keypad[key]) // Until key is released
-                            chip8->PC -= 2;
-                        else {
-                            chip8->V[chip8->inst.X] = key; // VX = key
-                            key = 0xFF;                    // Reset key to "not found"
-                            anykey_pressed = false;        // Reset to "Nothing Pressed"
-                        }
-                    } break;
-                }
-                case 0x1E:
-                    // 0xFX1E: I += VX; Add VX to Register 1
-                    chip8->I += chip8->V[chip8->inst.X];
-                    SDL_Log("0xFX1E: I += VX; I set to %04X", chip8->I);
-                    break;
-                case 0x07:
-                    // 0xFX07: VX = delay timer
-                    chip8->V[chip8->inst.X] = chip8->delay_timer;
-                    SDL_Log("0xFX07: VX[%X] set to delay timer value %X", chip8->inst.X, chip8->V[chip8->inst.X]);
-                    break;
-                case 0x15:
-                    // 0xFX15: delay timer = VX
-                    chip8->delay_timer = chip8->V[chip8->inst.X];
-                    SDL_Log("0xFX15: delay timer set to VX[%X] value %X", chip8->inst.X, chip8->V[chip8->inst.X]);
-                    break;
-                case 0x29:
-                    // 0xFX29: Set register I to sprite location in memory for character in VX (0x0-0xF)
-                    chip8->I = chip8->V[chip8->inst.X] * 5;
-                    SDL_Log("0xFX29: I set to sprite location in memory for VX[%X]. I set to %04X", chip8->inst.X, chip8->I);
-                    break;
-                case 0x33: {
-                    // 0xFX33: Store binary-coded decimal representation of VX at memory offset from I
-                    // I = hundreds, I + 1 = tens, I + 2, ones
-                    uint8_t bcd = chip8->V[chip8->inst.X];
-                    chip8->ram[chip8->I + 2] = bcd % 10;
-                    bcd /= 10;
-                    chip8->ram[chip8->I + 1] = bcd % 10;
-                    bcd /= 10;
-                    chip8->ram[chip8->I] = bcd;
-                    break;
+        }
+    }
+    chip8->damage = DAMAGE_ALL;
+    TRACE_DEBUG("0x00FC: Scrolled left 4 pixels");
+}
+
+// 0x00FD: Exit the interpreter (SUPER-CHIP). The machine halts on this opcode until the user quits
+template <typename QUIRKS>
+void op_00FD(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    chip8->PC -= 2;
+    chip8->cycles = 0; // Nothing can change before the next batch
+    TRACE_DEBUG("0x00FD: Exit; halted at %04X", chip8->PC);
+}
+
+// 0x00FE: Lo-res 64x32 mode (SUPER-CHIP). Switching clears the display, every plane of it
+template <typename QUIRKS>
+void op_00FE(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    chip8->hires = false;
+    memset(&chip8->display[0], 0, QUIRKS::planes * sizeof chip8->display[0]);
+    chip8->damage = DAMAGE_ALL;
+    TRACE_DEBUG("0x00FE: Lo-res mode");
+}
+
+// 0x00FF: Hi-res 128x64 mode (SUPER-CHIP). Switching clears the display
+template <typename QUIRKS>
+void op_00FF(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    chip8->hires = true;
+    memset(&chip8->display[0], 0, QUIRKS::planes * sizeof chip8->display[0]);
+    chip8->damage = DAMAGE_ALL;
+    TRACE_DEBUG("0x00FF: Hi-res mode");
+}
+
+// 0x1NNN: Jump to address NNN
+template <typename QUIRKS>
+void op_1NNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    TRACE_DEBUG("Before jump. PC: %04X", chip8->PC);
+    chip8->PC = chip8->inst.NNN; // Set program counter so that the next opcode is from NNN
+    TRACE_DEBUG("0x01: Jump to address NNN. PC set to %04X", chip8->PC);
+    skip_idle_loop(chip8); // Jumps are where idle loops close
+}
+
+// 0x2NNN: Call subroutine at NNN
+template <typename QUIRKS>
+void op_2NNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // Store current address to return to on subroutine stack ("push")
+    // and set program counter to subroutine address so that the next opcode is gotten from there
+    TRACE_DEBUG("Stack depth before push: %d", chip8->stack_ptr - chip8->stack);
+    *chip8->stack_ptr++ = chip8->PC; // Save current program counter on stack; increment stack pointer
+    TRACE_DEBUG("Stack depth after push: %d", chip8->stack_ptr - chip8->stack);
+    chip8->PC = chip8->inst.NNN; // Extract 12-bit and assign to program counter
+    TRACE_DEBUG("0x02: Call subroutine at NNN. PC set to %04X", chip8->PC);
+}
+
+// 0x3XNN: Check if VX == NN, if so, skip next instruction
+template <typename QUIRKS>
+void op_3XNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if (chip8->V[chip8->inst.X] == chip8->inst.NN) {
+        chip8->PC += skip_length<QUIRKS>(chip8); // Skips instruction
+        TRACE_DEBUG("0x03: Skip next instruction. VX[%X] == NN(%X)", chip8->inst.X, chip8->inst.NN);
+    }
+}
+
+// 0x4XNN: Check if VX != NN, if so, skip next instruction
+template <typename QUIRKS>
+void op_4XNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if (chip8->V[chip8->inst.X] != chip8->inst.NN) {
+        chip8->PC += skip_length<QUIRKS>(chip8); // Skips instruction
+        TRACE_DEBUG("0x04: Skip next instruction. VX[%X] != NN(%X)", chip8->inst.X, chip8->inst.NN);
+    }
+}
+
+// 0x5XY0: Check if VX == VY, if so, skip next instruction
+template <typename QUIRKS>
+void op_5XY0(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if (chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y]) {
+        chip8->PC += skip_length<QUIRKS>(chip8);
+        TRACE_DEBUG("0x05: Skip next instruction. VX[%X] == VY[%X]", chip8->inst.X, chip8->inst.Y);
+    }
+}
+
+// 0x5XY2: Store VX-VY inclusive at I, in descending order when X > Y; I is unchanged (XO-CHIP)
+template <typename QUIRKS>
+void op_5XY2(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::xochip) return op_invalid<QUIRKS>(chip8, config);
+    const uint8_t X = chip8->inst.X, Y = chip8->inst.Y;
+    const uint32_t count = (X < Y ? Y - X : X - Y) + 1;
+    for (uint32_t i = 0; i < count; i++)
+        chip8->ram[ram_address<QUIRKS>(chip8->I + i)] = chip8->V[X < Y ? X + i : X - i];
+    invalidate_decode_cache(chip8, chip8->I, count);
+    TRACE_DEBUG("0x5XY2: Stored V%X-V%X at I %04X", X, Y, chip8->I);
+}
+
+// 0x5XY3: Load VX-VY inclusive from I, in descending order when X > Y; I is unchanged (XO-CHIP)
+template <typename QUIRKS>
+void op_5XY3(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::xochip) return op_invalid<QUIRKS>(chip8, config);
+    const uint8_t X = chip8->inst.X, Y = chip8->inst.Y;
+    const uint32_t count = (X < Y ? Y - X : X - Y) + 1;
+    for (uint32_t i = 0; i < count; i++)
+        chip8->V[X < Y ? X + i : X - i] = chip8->ram[ram_address<QUIRKS>(chip8->I + i)];
+    TRACE_DEBUG("0x5XY3: Loaded V%X-V%X from I %04X", X, Y, chip8->I);
+}
+
+// 0x6XNN: Set register VX to NN
+template <typename QUIRKS>
+void op_6XNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->V[chip8->inst.X] = chip8->inst.NN;
+    TRACE_DEBUG("0x06: Set VX[%X] to NN(%X)", chip8->inst.X, chip8->inst.NN);
+}
+
+// 0x7XNN: Set register VX += NN
+template <typename QUIRKS>
+void op_7XNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->V[chip8->inst.X] += chip8->inst.NN;
+    TRACE_DEBUG("0x07: Add NN(%X) to VX[%X]", chip8->inst.NN, chip8->inst.X);
+}
+
+// 0x8XY0: Assignment (VX, VY)
+template <typename QUIRKS>
+void op_8XY0(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
+    TRACE_DEBUG("0x08XY0: VX[%X] = VY[%X]", chip8->inst.X, chip8->inst.Y);
+}
+
+// 0x8XY1: Set register VX |= VY
+template <typename QUIRKS>
+void op_8XY1(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
+    if constexpr (QUIRKS::vf_reset)
+        chip8->V[0xF] = 0;  // Reset VF to 0
+    TRACE_DEBUG("DEBUG: Executed 0x8XY1 instruction. V[%X] = V[%X] | V[%X]", chip8->inst.X, chip8->inst.X, chip8->inst.Y);
+}
+
+// 0x8XY2: Set register VX &= VY
+template <typename QUIRKS>
+void op_8XY2(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
+    if constexpr (QUIRKS::vf_reset)
+        chip8->V[0xF] = 0;  // Reset VF to 0
+    TRACE_DEBUG("DEBUG: Executed 0x8XY2 instruction. V[%X] = V[%X] & V[%X]", chip8->inst.X, chip8->inst.X, chip8->inst.Y);
+}
+
+// 0x8XY3: Set register VX ^= VY
+template <typename QUIRKS>
+void op_8XY3(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
+    if constexpr (QUIRKS::vf_reset)
+        chip8->V[0xF] = 0;  // Reset VF to 0
+    TRACE_DEBUG("DEBUG: Executed 0x8XY3 instruction. V[%X] = V[%X] ^ V[%X]", chip8->inst.X, chip8->inst.X, chip8->inst.Y);
+}
+
+// 0x8XY4: Bitwise ADD_CARRY (VX, VY) 1 if carry 0 if not
+template <typename QUIRKS>
+void op_8XY4(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    const bool carry = ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255);
+    chip8->V[chip8->inst.X] += chip8->V[chip8->inst.Y];
+    chip8->V[0xF] = carry; // Set last data register to carry
+    TRACE_DEBUG("0x08XY4: VX[%X] += VY[%X]. Carry: %d", chip8->inst.X, chip8->inst.Y, carry);
+}
+
+// 0x8XY5: Bitwise SUBTRACT_BORROW (VX - VY) 1 if not borrow 0 if borrow
+template <typename QUIRKS>
+void op_8XY5(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    const bool carry = (chip8->V[chip8->inst.Y] <= chip8->V[chip8->inst.X]); // Check for borrow
+    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
+    chip8->V[0xF] = carry; // Set last data register to carry
+    TRACE_DEBUG("0x08XY5: VX[%X] -= VY[%X]. Borrow: %d", chip8->inst.X, chip8->inst.Y, !carry);
+}
+
+// 0x8XY6: Set register VX >>= 1, store shifted off bit in carry
+template <typename QUIRKS>
+void op_8XY6(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    bool carry;
+    if constexpr (QUIRKS::shift_uses_vy) {
+        carry = chip8->V[chip8->inst.Y] & 1;    // Use VY
+        chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1; // Set VX = VY result
+    } else {
+        carry = chip8->V[chip8->inst.X] & 1;    // Use VX
+        chip8->V[chip8->inst.X] >>= 1;          // Use VX
+    }
+    chip8->V[0xF] = carry; // Set last data register to carry
+    TRACE_DEBUG("DEBUG: Executed 0x8%X (SHR V%X, V%X) instruction. Shifted VX >>= 1. VF = %d", chip8->inst.opcode & 0x00FF, chip8->inst.X, chip8->inst.Y, chip8->V[0xF]);
+}
+
+// 0x8XY7: Bitwise SUBTRACT_BORROW (VY - VX) 1 if not borrow 0 if borrow
+template <typename QUIRKS>
+void op_8XY7(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    const bool carry = (chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y]); // Check for borrow
+    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
+    chip8->V[0xF] = carry; // Set last data register to carry
+    TRACE_DEBUG("0x08XY7: VX[%X] = VY[%X] - VX[%X]. Borrow: %d", chip8->inst.X, chip8->inst.Y, chip8->inst.X, !carry);
+}
+
+// 0x8XYE: Set register VX <<= 1, store shifted off bit in carry
+template <typename QUIRKS>
+void op_8XYE(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    bool carry;
+    if constexpr (QUIRKS::shift_uses_vy) {
+        carry = (chip8->V[chip8->inst.Y] & 0x80) >> 7;  // Use VY
+        chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] << 1; // Set VX = VY result
+    } else {
+        carry = (chip8->V[chip8->inst.X] & 0x80) >> 7;  // VX
+        chip8->V[chip8->inst.X] <<= 1;                  // Use VX
+    }
+    chip8->V[0xF] = carry; // Set last data register to carry
+    TRACE_DEBUG("DEBUG: Executed 0x8%X (SHL V%X, V%X) instruction. Shifted VX <<= 1. VF = %d", chip8->inst.opcode & 0x00FF, chip8->inst.X, chip8->inst.Y, chip8->V[0xF]);
+}
+
+// 0x9XY0: Check if VX != VY; Skip next instruction if so
+template <typename QUIRKS>
+void op_9XY0(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y])
+        chip8->PC += skip_length<QUIRKS>(chip8);
+}
+
+// 0xANNN: Set index register I to NNN
+template <typename QUIRKS>
+void op_ANNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->I = chip8->inst.NNN;
+    TRACE_DEBUG("0x0ANNN: I set to %04X", chip8->I);
+}
+
+// 0xBNNN: Jump to V0 + NNN (SUPER-CHIP: BXNN, jump to VX + XNN)
+template <typename QUIRKS>
+void op_BNNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // Set program counter to sum of the first data register and the 12-bit address
+    chip8->PC = chip8->V[QUIRKS::jump_uses_vx ? chip8->inst.X : 0] + chip8->inst.NNN;
+    TRACE_DEBUG("0x0BNNN: Jump to V0 + NNN. PC set to %04X", chip8->PC);
+}
+
+// 0xCXNN: Sets register VX = random byte & NN (Bitwise AND)
+template <typename QUIRKS>
+void op_CXNN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // xorshift32 on the machine's own state, so machines on different threads never share a sequence
+    chip8->rng ^= chip8->rng << 13;
+    chip8->rng ^= chip8->rng >> 17;
+    chip8->rng ^= chip8->rng << 5;
+    chip8->V[chip8->inst.X] = (chip8->rng >> 24) & chip8->inst.NN;
+    TRACE_DEBUG("0x0CNNN: VX[%X] = random byte & NN(%X)", chip8->inst.X, chip8->inst.NN);
+}
+
+// Sprite row data (leftmost pixel in the top bit) placed at column x of a row words wide.
+// Clipping drops what passes the right edge; otherwise it wraps around to the left
+static inline void place_sprite_row(const uint64_t data, const uint32_t x, const uint32_t words, const bool clip,
+                                    uint64_t row[DISPLAY_WORDS]) {
+    if (words == 1) {
+        row[0] = clip ? data >> x : std::rotr(data, x);
+        return; }
+    const uint32_t shift = x % 64;
+    const uint64_t head = data >> shift, tail = shift ? data << (64 - shift) : 0;
+    row[x / 64] = head;
+    row[1 - x / 64] = x < 64 ? tail : clip ? 0 : tail; // Past the right edge from the second word
+}
+
+// 0xDXYN: Draw N-height sprite at coords X, Y; read from memory location I
+// (SUPER-CHIP: DXY0 draws a 16x16 sprite of 2-byte rows, in either resolution. XO-CHIP draws into
+// every selected plane in turn, each taking the next sprite's worth of bytes from I)
+template <typename QUIRKS>
+void op_DXYN(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // Screen pixels are XOR'd with sprite bits,
+    // VF (Carry Flag) is set if any screen pixels are set off; useful for collision detection
+    uint64_t collision = 0;
+
+    if constexpr (!QUIRKS::superchip) {
+        const uint8_t X_coord = chip8->V[chip8->inst.X] % LORES_WIDTH;
+        const uint8_t Y_coord = chip8->V[chip8->inst.Y] % LORES_HEIGHT;
+
+        // One packed row per sprite byte: shifted into place it clips at the right edge, rotated it wraps
+        for (uint8_t i = 0; i < chip8->inst.N; i++) {
+            if (QUIRKS::clip_sprites && Y_coord + i >= LORES_HEIGHT) break; // Stop at the bottom edge
+            const uint64_t sprite_data = (uint64_t)chip8->ram[ram_address<QUIRKS>(chip8->I + i)] << (LORES_WIDTH - 8);
+            const uint64_t sprite_row = QUIRKS::clip_sprites ? sprite_data >> X_coord : std::rotr(sprite_data, X_coord);
+            const uint32_t y = (Y_coord + i) % LORES_HEIGHT;
+            collision |= chip8->display[0][y][0] & sprite_row; // Sprite bit and display pixel both on
+            chip8->display[0][y][0] ^= sprite_row;
+            chip8->damage |= (uint64_t)(sprite_row != 0) << y; // Clipped off-screen rows change nothing
+        }
+    } else {
+        // VF is set on any collision, as modern SUPER-CHIP interpreters do, not a count of rows
+        const uint32_t width = chip8->hires ? DISPLAY_WIDTH : LORES_WIDTH, height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+        const uint32_t X_coord = chip8->V[chip8->inst.X] % width;
+        const uint32_t Y_coord = chip8->V[chip8->inst.Y] % height;
+        const uint32_t rows = chip8->inst.N ? chip8->inst.N : 16;
+        const uint32_t planes = selected_planes<QUIRKS>(chip8);
+        uint16_t sprite = chip8->I;
+
+        for (uint32_t p = 0; p < QUIRKS::planes; p++) {
+            if (!(planes >> p & 1)) continue;
+            DISPLAY_ROW_T *display = chip8->display[p];
+            for (uint32_t i = 0; i < rows; i++) {
+                if (QUIRKS::clip_sprites && Y_coord + i >= height) break;
+                const uint64_t sprite_data = chip8->inst.N ? (uint64_t)chip8->ram[ram_address<QUIRKS>(sprite + i)] << 56
+                                                           : (uint64_t)(chip8->ram[ram_address<QUIRKS>(sprite + 2 * i)] << 8 |
+                                                                        chip8->ram[ram_address<QUIRKS>(sprite + 2 * i + 1)]) << 48;
+                uint64_t sprite_row[DISPLAY_WORDS];
+                place_sprite_row(sprite_data, X_coord, width / 64, QUIRKS::clip_sprites, sprite_row);
+                const uint32_t y = (Y_coord + i) % height;
+                uint64_t drawn = 0;
+                for (uint32_t w = 0; w < width / 64; w++) {
+                    collision |= display[y][w] & sprite_row[w];
+                    display[y][w] ^= sprite_row[w];
+                    drawn |= sprite_row[w];
                 }
-                case 0x55:
-                    // 0xFX55: Register dump V0-VX inclusive to memory offset from I;
-                    // SCHIP does not increment I, CHIP8 does increment I
-                    for (uint8_t i = 0; i <= chip8->inst.X; i++) {
-                        if (config.current_ex == CHIP8) {
-                            chip8->ram[chip8->I++] = chip8->V[i]; // Increment I each time
-                        } else {
-                            chip8->ram[chip8->I + i] = chip8->V[i];
-                        }
-                    }
-                    SDL_Log("DEBUG: Executed 0x55 (LD [I], Vx) instruction. Dumped registers V0-V%X to memory at address I.", chip8->inst.X);
-                    break;
-                case 0x65:
-                    // 0xFX65: Register load V0-VX inclusive from memory offset from I;
-                    // SCHIP does not increment I, CHIP8 does increment I
-                    for (uint8_t i = 0; i <= chip8->inst.X; i++) {
-                        if (config.current_ex == CHIP8) {
-                            chip8->V[i] = chip8->ram[chip8->I++]; // Increment I each time
-                        } else {
-                            chip8->V[i] = chip8->ram[chip8->I + i];
-                        }
-                    }
-                    
-                    SDL_Log("DEBUG: Executed 0x65 (LD Vx, [I]) instruction. Loaded registers V0-V%X from memory at address I.", chip8->inst.X);
-                    break;
-            } break;
-        default: break; // Invalid opcode
+                chip8->damage |= (uint64_t)(drawn != 0) << y;
+            }
+            sprite += chip8->inst.N ? rows : 2 * rows;
+        }
     }
+    chip8->V[0xF] = collision != 0;
+    TRACE_DEBUG("0x0DXYN: Draw sprite. VF(Carry): %d", chip8->V[0xF]);
+    TRACE_DEBUG("Program Counter after 0x0DXYN: 0x%04X", chip8->PC);
 }
 
-int main(int argc, char *argv[]) {
-    (void)argc;
-    (void)argv;
+// 0xEX9E: Skip next instruction if key in VX pressed
+template <typename QUIRKS>
+void op_EX9E(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if (chip8->keypad[chip8->V[chip8->inst.X]]) {
+        chip8->PC += skip_length<QUIRKS>(chip8);
+        TRACE_DEBUG("0x0EX9E: Skip next instruction. Key in V[%d] is pressed", chip8->inst.X);
+    }
+}
 
-    // Default Usage message for args
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <rom_name>\n", argv[0]);
-        exit(EXIT_FAILURE); }
-    
-    CONFIG_T config = {0}; // Initialize emulator options
-    if (!set_config_from_args(&config, argc, (const char **) argv)) exit(EXIT_FAILURE);
-    
-    SDL_T sdl = {nullptr}; // Initialize SDL
-    if (!INIT(&sdl, config)) exit(EXIT_FAILURE);
-    
-    CHIP_8 chip8 = {};
-    const char *rom_name = argv[1];
-    if (!init_chip8(&chip8, rom_name)) exit(EXIT_FAILURE); // Initialize CHIP-8 machine
-    
-    clear_screen(config, sdl); // Initial screen clear
+// 0xEXA1: Skip next instruction if key in VX not pressed
+template <typename QUIRKS>
+void op_EXA1(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if (!chip8->keypad[chip8->V[chip8->inst.X]]) {
+        chip8->PC += skip_length<QUIRKS>(chip8);
+        TRACE_DEBUG("0x0EXA1: Skip next instruction. Key in V[%d] is not pressed", chip8->inst.X);
+    }
+}
+
+// 0xF000 NNNN: Set register I to the 16-bit address in the following word (XO-CHIP)
+template <typename QUIRKS>
+void op_F000(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::xochip) return op_invalid<QUIRKS>(chip8, config);
+    chip8->I = chip8->ram[chip8->PC] << 8 | chip8->ram[ram_address<QUIRKS>(chip8->PC + 1)];
+    chip8->PC += 2;
+    TRACE_DEBUG("0xF000: I set to %04X", chip8->I);
+}
+
+// 0xFN01: Select bitplanes N for drawing, clearing and scrolling (XO-CHIP)
+template <typename QUIRKS>
+void op_FN01(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::xochip) return op_invalid<QUIRKS>(chip8, config);
+    chip8->planes = chip8->inst.X;
+    TRACE_DEBUG("0xFN01: Planes set to %X", chip8->planes);
+}
+
+// 0xF002: Load the 16-byte audio pattern buffer from I (XO-CHIP)
+template <typename QUIRKS>
+void op_F002(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::xochip) return op_invalid<QUIRKS>(chip8, config);
+    for (uint32_t i = 0; i < sizeof chip8->audio_pattern; i++) chip8->audio_pattern[i] = chip8->ram[ram_address<QUIRKS>(chip8->I + i)];
+    TRACE_DEBUG("0xF002: Audio pattern loaded from I %04X", chip8->I);
+}
 
-    // Main emulator loop
-    while (chip8.state != QUIT) {
-        handle_input(&chip8); // Handle user input
+// 0xFX07: VX = delay timer
+template <typename QUIRKS>
+void op_FX07(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->V[chip8->inst.X] = chip8->delay_timer;
+    TRACE_DEBUG("0xFX07: VX[%X] set to delay timer value %X", chip8->inst.X, chip8->V[chip8->inst.X]);
+}
+
+// 0xFX0A: VX = get_key(); await until a keypress, and store in VX
+template <typename QUIRKS>
+void op_FX0A(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+
+    for (uint8_t i = 0; !chip8->anykey_pressed && i < sizeof chip8->keypad; i++) {
+        if (chip8->keypad[i]) {
+            chip8->key = i; // i = key offset for keypad array
+            chip8->anykey_pressed = true;
+        }
+    } if (!chip8->anykey_pressed) { // If no key pressed, keep getting the current opcode & running instruction
+        chip8->PC -= 2;
+        chip8->cycles = 0; // Keypad can't change before the next batch, so neither will this
+        TRACE_DEBUG("0xFX0A: Waiting for key press. PC decremented to %04X", chip8->PC);
+    } else {
+        if (chip8->keypad[chip8->key]) { // Until key is released
+            chip8->PC -= 2;
+            chip8->cycles = 0;
+        } else {
+            chip8->V[chip8->inst.X] = chip8->key; // VX = key
+            chip8->anykey_pressed = false;        // Reset to "Nothing Pressed"
+        }
+    }
+}
+
+// 0xFX15: delay timer = VX
+template <typename QUIRKS>
+void op_FX15(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->delay_timer = chip8->V[chip8->inst.X];
+    TRACE_DEBUG("0xFX15: delay timer set to VX[%X] value %X", chip8->inst.X, chip8->V[chip8->inst.X]);
+}
+
+// 0xFX18: sound timer = VX; the audio pattern plays while it is nonzero
+template <typename QUIRKS>
+void op_FX18(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->sound_timer = chip8->V[chip8->inst.X];
+    TRACE_DEBUG("0xFX18: sound timer set to VX[%X] value %X", chip8->inst.X, chip8->V[chip8->inst.X]);
+}
+
+// 0xFX1E: I += VX; Add VX to Register 1
+template <typename QUIRKS>
+void op_FX1E(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->I += chip8->V[chip8->inst.X];
+    TRACE_DEBUG("0xFX1E: I += VX; I set to %04X", chip8->I);
+}
+
+// 0xFX29: Set register I to sprite location in memory for character in VX (0x0-0xF)
+template <typename QUIRKS>
+void op_FX29(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    chip8->I = chip8->V[chip8->inst.X] * 5;
+    TRACE_DEBUG("0xFX29: I set to sprite location in memory for VX[%X]. I set to %04X", chip8->inst.X, chip8->I);
+}
 
-        if (chip8.state == PAUSED) continue;
-        
-        const uint64_t before_frame = SDL_GetPerformanceCounter(); // Time before instruction
+// 0xFX30: Set register I to the 8x10 big font digit for VX (SUPER-CHIP)
+template <typename QUIRKS>
+void op_FX30(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    chip8->I = BIG_FONT_ADDRESS + (chip8->V[chip8->inst.X] & 0xF) * 10;
+    TRACE_DEBUG("0xFX30: I set to big font digit for VX[%X]. I set to %04X", chip8->inst.X, chip8->I);
+}
 
-        // Emulate instructions
-        for (uint32_t i = 0; i < config.clock_rate / 60; i++)
-            emulate_instructions(&chip8, config);
-        
-        const uint64_t after_frame = SDL_GetPerformanceCounter(); // Time taken to run instruction (Elapsed)
+// 0xFX33: Store binary-coded decimal representation of VX at memory offset from I
+template <typename QUIRKS>
+void op_FX33(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // I = hundreds, I + 1 = tens, I + 2, ones
+    uint8_t bcd = chip8->V[chip8->inst.X];
+    chip8->ram[ram_address<QUIRKS>(chip8->I + 2)] = bcd % 10;
+    bcd /= 10;
+    chip8->ram[ram_address<QUIRKS>(chip8->I + 1)] = bcd % 10;
+    bcd /= 10;
+    chip8->ram[ram_address<QUIRKS>(chip8->I)] = bcd;
+    invalidate_decode_cache(chip8, chip8->I, 3);
+}
 
-        // Calculate time elapsed in seconds between two frames and store the result in the variable time_elapsed
-        const double time_elapsed = (double)((after_frame - before_frame) / 1000) / SDL_GetPerformanceFrequency();
+// 0xFX3A: Audio pattern pitch = VX (XO-CHIP)
+template <typename QUIRKS>
+void op_FX3A(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::xochip) return op_invalid<QUIRKS>(chip8, config);
+    chip8->pitch = chip8->V[chip8->inst.X];
+    TRACE_DEBUG("0xFX3A: Pitch set to VX[%X] value %X", chip8->inst.X, chip8->pitch);
+}
 
-        if (16.67f > time_elapsed) SDL_Delay(16.67f - time_elapsed);
-        
-        clear_screen(config, sdl);
-        
-        update_screen(sdl, config, chip8);
-        update_timers(&chip8);
+// 0xFX55: Register dump V0-VX inclusive to memory offset from I;
+template <typename QUIRKS>
+void op_FX55(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // SCHIP does not increment I, CHIP8 does increment I
+    const uint16_t start = chip8->I;
+    for (uint8_t i = 0; i <= chip8->inst.X; i++) {
+        if constexpr (QUIRKS::load_store_increments_i) {
+            chip8->ram[ram_address<QUIRKS>(chip8->I++)] = chip8->V[i]; // Increment I each time
+        } else {
+            chip8->ram[ram_address<QUIRKS>(chip8->I + i)] = chip8->V[i];
+        }
     }
-    
-    final_cleanup(sdl);
-    exit(EXIT_SUCCESS);
+    invalidate_decode_cache(chip8, start, chip8->inst.X + 1);
+    TRACE_DEBUG("DEBUG: Executed 0x55 (LD [I], Vx) instruction. Dumped registers V0-V%X to memory at address I.", chip8->inst.X);
+}
+
+// 0xFX65: Register load V0-VX inclusive from memory offset from I;
+template <typename QUIRKS>
+void op_FX65(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    // SCHIP does not increment I, CHIP8 does increment I
+    for (uint8_t i = 0; i <= chip8->inst.X; i++) {
+        if constexpr (QUIRKS::load_store_increments_i) {
+            chip8->V[i] = chip8->ram[ram_address<QUIRKS>(chip8->I++)]; // Increment I each time
+        } else {
+            chip8->V[i] = chip8->ram[ram_address<QUIRKS>(chip8->I + i)];
+        }
+    }
+
+    TRACE_DEBUG("DEBUG: Executed 0x65 (LD Vx, [I]) instruction. Loaded registers V0-V%X from memory at address I.", chip8->inst.X);
+}
+
+// 0xFX75: Save V0-VX inclusive to the RPL user flags (SUPER-CHIP)
+template <typename QUIRKS>
+void op_FX75(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    memcpy(chip8->rpl, chip8->V, chip8->inst.X + 1);
+    TRACE_DEBUG("0xFX75: Saved V0-V%X to RPL flags", chip8->inst.X);
+}
+
+// 0xFX85: Load V0-VX inclusive from the RPL user flags (SUPER-CHIP)
+template <typename QUIRKS>
+void op_FX85(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    if constexpr (!QUIRKS::superchip) return op_invalid<QUIRKS>(chip8, config);
+    memcpy(chip8->V, chip8->rpl, chip8->inst.X + 1);
+    TRACE_DEBUG("0xFX85: Loaded V0-V%X from RPL flags", chip8->inst.X);
+}
+
+// 0x0NNN/0x5XYN/...: Invalid opcode; also the SUPER-CHIP and XO-CHIP opcodes under quirk sets without them
+template <typename QUIRKS>
+void op_invalid(CHIP_8 *chip8, const CONFIG_T &config) {
+    (void)config;
+    switch ((chip8->inst.opcode >> 12) & 0x0F) {
+        case 0x00: TRACE_INFO("0x00: Invalid opcode. Ignoring instruction."); break;
+        case 0x05: TRACE_INFO("0x05: Invalid opcode. Ignoring instruction."); break;
+        default: break;
+    }
+}
+
+// Every handler exists once per quirk set the emulator supports
+#define X(name) template void op_##name<QUIRKS_T<CHIP8>>(CHIP_8 *chip8, const CONFIG_T &config); \
+                template void op_##name<QUIRKS_T<SUPERCHIP>>(CHIP_8 *chip8, const CONFIG_T &config); \
+                template void op_##name<QUIRKS_T<XOCHIP>>(CHIP_8 *chip8, const CONFIG_T &config);
+CHIP8_OPCODES(X)
+#undef X
+
+// Superinstruction: run FIRST, then SECOND from the same dispatch. SECOND only runs while control
+// falls through FIRST and the batch has budget left; otherwise it is dispatched on its own later
+template <typename QUIRKS, OPCODE_HANDLER_T FIRST, OPCODE_HANDLER_T SECOND>
+void op_fused(CHIP_8 *chip8, const CONFIG_T &config) {
+    const uint16_t next = chip8->PC;
+    FIRST(chip8, config);
+    if (chip8->PC != next || chip8->cycles == 0) return;
+
+    chip8->cycles--;
+    chip8->inst = chip8->decode_cache[next - 2].fused;
+    chip8->PC += 2;
+    SECOND(chip8, config);
+}
+
+// Handler per OPCODE_T, superinstructions included, specialised for one quirk set
+template <typename QUIRKS>
+constexpr OPCODE_HANDLER_T op_handlers[OP_DISPATCH_COUNT] = {
+#define X(name) op_##name<QUIRKS>,
+    CHIP8_OPCODES(X)
+#undef X
+#define X(first, second) op_fused<QUIRKS, op_##first<QUIRKS>, op_##second<QUIRKS>>,
+    CHIP8_FUSED_OPCODES(X)
+#undef X
+};
+
+// Superinstruction for an adjacent opcode pair, or OP_invalid if the pair isn't fused
+static OPCODE_T fuse_opcodes(const OPCODE_T first, const OPCODE_T second) {
+#define X(a, b) if (first == OP_##a && second == OP_##b) return OP_##a##_##b;
+    CHIP8_FUSED_OPCODES(X)
+#undef X
+    return OP_invalid;
+}
+
+// Fill a decode cache entry from the opcode at PC, fusing it with the following opcode where possible
+template <typename QUIRKS>
+void decode_entry(CHIP_8 *chip8, DECODED_T *entry, const uint16_t PC) {
+    // Fetch the next 16-bit opcode from memory (RAM) by combining the higher 8 bits from the current address with the lower 8 bits from the next address
+    entry->inst = decode_operands((chip8->ram[PC] << 8) | chip8->ram[PC + 1]);
+    entry->op = decode_opcode(entry->inst);
+
+    if (PC < QUIRKS::memory_size - 3) {
+        const INSTRUCTION_T second = decode_operands((chip8->ram[PC + 2] << 8) | chip8->ram[PC + 3]);
+        const OPCODE_T fused = fuse_opcodes(entry->op, decode_opcode(second));
+        if (fused != OP_invalid) {
+            entry->op = fused;
+            entry->fused = second;
+        }
+    }
+    entry->handler = op_handlers<QUIRKS>[entry->op];
+}
+
+// Emulate CHIP-8 instruction
+template <typename QUIRKS>
+void emulate_instructions(CHIP_8 *chip8, const CONFIG_T &config) {
+    const uint16_t PC = chip8->PC;
+    OPCODE_HANDLER_T handler;
+
+    if (PC < QUIRKS::memory_size - 1) {
+        // Serve operands and handler from the decode cache, decoding on first visit
+        DECODED_T *entry = &chip8->decode_cache[PC];
+        if (!entry->handler) decode_entry<QUIRKS>(chip8, entry, PC);
+        chip8->inst = entry->inst;
+        handler = entry->handler;
+    } else {
+        // Opcode straddles the end of the quirk set's memory, not cacheable; wrap around instead of reading past it
+        chip8->inst = decode_operands((chip8->ram[PC % QUIRKS::memory_size] << 8) | chip8->ram[(PC + 1) % QUIRKS::memory_size]);
+        handler = op_handlers<QUIRKS>[decode_opcode(chip8->inst)];
+    }
+
+    chip8->PC += 2; // Pre-increment program counter for next opcode
+    handler(chip8, config); // Emulate opcode
+}
+
+// Emulate one instruction with the machine's quirk set
+void emulate_instructions(CHIP_8 *chip8, const CONFIG_T &config) {
+    switch (chip8->extension) {
+        case CHIP8: emulate_instructions<QUIRKS_T<CHIP8>>(chip8, config); break;
+        case SUPERCHIP: emulate_instructions<QUIRKS_T<SUPERCHIP>>(chip8, config); break;
+        case XOCHIP: emulate_instructions<QUIRKS_T<XOCHIP>>(chip8, config); break;
+    }
+}
+
+// Emulate chip8->cycles instructions through the decode cache's handler pointers
+template <typename QUIRKS>
+void run_switch(CHIP_8 *chip8, const CONFIG_T &config) {
+    while (chip8->cycles) {
+        chip8->cycles--;
+        emulate_instructions<QUIRKS>(chip8, config);
+    }
+}
+
+#ifdef CHIP8_HAS_COMPUTED_GOTO
+// Emulate chip8->cycles instructions with direct threading: every handler body ends in its own
+// indirect jump to the next handler, so the branch predictor sees one site per opcode
+template <typename QUIRKS>
+void run_threaded(CHIP_8 *chip8, const CONFIG_T &config) {
+    static const void *const labels[OP_DISPATCH_COUNT] = {
+#define X(name) &&L_##name,
+        CHIP8_OPCODES(X)
+#undef X
+#define X(first, second) &&L_##first##_##second,
+        CHIP8_FUSED_OPCODES(X)
+#undef X
+    };
+    DECODED_T *entry;
+
+#define DISPATCH() do { \
+        if (chip8->cycles == 0) return; \
+        chip8->cycles--; \
+        if (chip8->PC >= QUIRKS::memory_size - 1) { emulate_instructions<QUIRKS>(chip8, config); goto next; } \
+        entry = &chip8->decode_cache[chip8->PC]; \
+        if (!entry->handler) decode_entry<QUIRKS>(chip8, entry, chip8->PC); \
+        chip8->inst = entry->inst; \
+        chip8->PC += 2; \
+        goto *labels[entry->op]; \
+    } while (0)
+
+next:
+    DISPATCH();
+#define X(name) L_##name: op_##name<QUIRKS>(chip8, config); DISPATCH();
+    CHIP8_OPCODES(X)
+#undef X
+#define X(first, second) L_##first##_##second: op_fused<QUIRKS, op_##first<QUIRKS>, op_##second<QUIRKS>>(chip8, config); DISPATCH();
+    CHIP8_FUSED_OPCODES(X)
+#undef X
+#undef DISPATCH
+}
+#endif
+
+#ifdef CHIP8_HAS_JIT
+// ---------------------------------------------------------------------------------------------
+// x86-64 JIT: translates straight-line runs of CHIP-8 opcodes into native code.
+// Block calling convention: void block(CHIP_8 *chip8). rbx holds chip8 for the whole block,
+// r12d holds I, PC is a compile-time constant until the block's single store on exit.
+// V0-VF stay in CHIP_8 and are addressed off rbx; with rbx/r12 reserved and the ABI's
+// argument/scratch registers in use, there are not 16 spare host registers to pin them.
+// ---------------------------------------------------------------------------------------------
+
+// Append raw bytes to the code buffer
+static void jit_emit(JIT_T *jit, std::initializer_list<uint8_t> bytes) {
+    for (const uint8_t value : bytes) *jit->code_ptr++ = value;
+}
+
+static void jit_emit32(JIT_T *jit, const uint32_t value) {
+    memcpy(jit->code_ptr, &value, 4);
+    jit->code_ptr += 4;
+}
+
+static void jit_emit16(JIT_T *jit, const uint16_t value) {
+    memcpy(jit->code_ptr, &value, 2);
+    jit->code_ptr += 2;
+}
+
+// Emit op with a [rbx + offset] memory operand; modrm_reg is the /r or /digit field
+static void jit_emit_mem(JIT_T *jit, std::initializer_list<uint8_t> op, const uint8_t modrm_reg, const uint32_t offset) {
+    jit_emit(jit, op);
+    jit_emit(jit, {(uint8_t)(0x80 | (modrm_reg << 3) | 3)}); // mod=10 (disp32), rm=rbx
+    jit_emit32(jit, offset);
+}
+
+#define JIT_V(reg) ((uint32_t)(offsetof(CHIP_8, V) + (reg)))
+#define JIT_OFF(field) ((uint32_t)offsetof(CHIP_8, field))
+
+enum { JIT_EAX = 0, JIT_ECX = 1, JIT_EDX = 2 };
+
+// Can this opcode be translated, and does it end the block?
+static bool jit_supported(const OPCODE_T op, bool *ends_block) {
+    switch (op) {
+        case OP_6XNN: case OP_7XNN: case OP_8XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3:
+        case OP_8XY4: case OP_8XY5: case OP_8XY6: case OP_8XY7: case OP_8XYE:
+        case OP_ANNN: case OP_FX07: case OP_FX15: case OP_FX18: case OP_FX1E: case OP_FX29:
+            *ends_block = false;
+            return true;
+        case OP_00EE: case OP_1NNN: case OP_2NNN: case OP_BNNN:
+        case OP_3XNN: case OP_4XNN: case OP_5XY0: case OP_9XY0: case OP_EX9E: case OP_EXA1:
+            *ends_block = true;
+            return true;
+        default:
+            // 00E0, CXNN, DXYN, FX0A, FX33, FX55, FX65 and the SUPER-CHIP/XO-CHIP opcodes: left to the interpreter
+            return false;
+    }
+}
+
+// PC = condition ? skip_pc : next_pc, using the flags of the preceding compare
+static void jit_emit_skip(JIT_T *jit, const uint16_t next_pc, const uint16_t skip_pc, const bool skip_if_equal) {
+    jit_emit(jit, {0xB8}); jit_emit32(jit, next_pc);                 // mov eax, next_pc
+    jit_emit(jit, {0xB9}); jit_emit32(jit, skip_pc);                 // mov ecx, skip_pc
+    jit_emit(jit, {0x0F, (uint8_t)(skip_if_equal ? 0x44 : 0x45), 0xC1}); // cmove/cmovne eax, ecx
+    jit_emit_mem(jit, {0x66, 0x89}, JIT_EAX, JIT_OFF(PC));           // mov [PC], ax
+}
+
+// Translate one opcode at address addr; skips land on skip_pc
+template <typename QUIRKS>
+static void jit_emit_opcode(JIT_T *jit, const OPCODE_T op, const INSTRUCTION_T inst, const uint16_t addr, const uint16_t skip_pc) {
+    const uint16_t next_pc = addr + 2;
+
+    switch (op) {
+        case OP_6XNN: // mov byte [VX], NN
+            jit_emit_mem(jit, {0xC6}, 0, JIT_V(inst.X)); jit_emit(jit, {inst.NN});
+            break;
+        case OP_7XNN: // add byte [VX], NN
+            jit_emit_mem(jit, {0x80}, 0, JIT_V(inst.X)); jit_emit(jit, {inst.NN});
+            break;
+        case OP_8XY0:
+            jit_emit_mem(jit, {0x8A}, JIT_EAX, JIT_V(inst.Y));           // mov al, [VY]
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_V(inst.X));           // mov [VX], al
+            break;
+        case OP_8XY1: case OP_8XY2: case OP_8XY3:
+            jit_emit_mem(jit, {0x8A}, JIT_EAX, JIT_V(inst.X));           // mov al, [VX]
+            jit_emit_mem(jit, {(uint8_t)(op == OP_8XY1 ? 0x0A : op == OP_8XY2 ? 0x22 : 0x32)},
+                         JIT_EAX, JIT_V(inst.Y));                        // or/and/xor al, [VY]
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_V(inst.X));           // mov [VX], al
+            if (QUIRKS::vf_reset) { jit_emit_mem(jit, {0xC6}, 0, JIT_V(0xF)); jit_emit(jit, {0x00}); } // VF = 0
+            break;
+        case OP_8XY4:
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_EAX, JIT_V(inst.X));     // movzx eax, [VX]
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_ECX, JIT_V(inst.Y));     // movzx ecx, [VY]
+            jit_emit(jit, {0x01, 0xC8});                                 // add eax, ecx
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_V(inst.X));           // mov [VX], al
+            jit_emit(jit, {0xC1, 0xE8, 0x08});                           // shr eax, 8 (carry)
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_V(0xF));              // mov [VF], al
+            break;
+        case OP_8XY5: case OP_8XY7: {
+            // 8XY5: VX = VX - VY, 8XY7: VX = VY - VX; VF = no borrow
+            const uint8_t minuend = op == OP_8XY5 ? inst.X : inst.Y;
+            const uint8_t subtrahend = op == OP_8XY5 ? inst.Y : inst.X;
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_EAX, JIT_V(minuend));    // movzx eax, [minuend]
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_ECX, JIT_V(subtrahend)); // movzx ecx, [subtrahend]
+            jit_emit(jit, {0x39, 0xC8});                                 // cmp eax, ecx
+            jit_emit(jit, {0x0F, 0x93, 0xC2});                           // setae dl
+            jit_emit(jit, {0x29, 0xC8});                                 // sub eax, ecx
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_V(inst.X));           // mov [VX], al
+            jit_emit_mem(jit, {0x88}, JIT_EDX, JIT_V(0xF));              // mov [VF], dl
+            break;
+        }
+        case OP_8XY6: case OP_8XYE: {
+            const uint8_t source = QUIRKS::shift_uses_vy ? inst.Y : inst.X; // CHIP-8 shifts VY, later machines VX
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_EAX, JIT_V(source));     // movzx eax, [source]
+            jit_emit(jit, {0x89, 0xC2});                                 // mov edx, eax
+            if (op == OP_8XY6) {
+                jit_emit(jit, {0x83, 0xE2, 0x01});                       // and edx, 1
+                jit_emit(jit, {0xD1, 0xE8});                             // shr eax, 1
+            } else {
+                jit_emit(jit, {0xC1, 0xEA, 0x07});                       // shr edx, 7
+                jit_emit(jit, {0x01, 0xC0});                             // add eax, eax
+            }
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_V(inst.X));           // mov [VX], al
+            jit_emit_mem(jit, {0x88}, JIT_EDX, JIT_V(0xF));              // mov [VF], dl
+            break;
+        }
+        case OP_ANNN: // mov r12d, NNN
+            jit_emit(jit, {0x41, 0xBC}); jit_emit32(jit, inst.NNN);
+            break;
+        case OP_FX07:
+            jit_emit_mem(jit, {0x8A}, JIT_EAX, JIT_OFF(delay_timer));    // mov al, [delay_timer]
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_V(inst.X));           // mov [VX], al
+            break;
+        case OP_FX15:
+            jit_emit_mem(jit, {0x8A}, JIT_EAX, JIT_V(inst.X));           // mov al, [VX]
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_OFF(delay_timer));    // mov [delay_timer], al
+            break;
+        case OP_FX18:
+            jit_emit_mem(jit, {0x8A}, JIT_EAX, JIT_V(inst.X));           // mov al, [VX]
+            jit_emit_mem(jit, {0x88}, JIT_EAX, JIT_OFF(sound_timer));    // mov [sound_timer], al
+            break;
+        case OP_FX1E:
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_EAX, JIT_V(inst.X));     // movzx eax, [VX]
+            jit_emit(jit, {0x41, 0x01, 0xC4});                           // add r12d, eax
+            break;
+        case OP_FX29:
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_EAX, JIT_V(inst.X));     // movzx eax, [VX]
+            jit_emit(jit, {0x44, 0x8D, 0x24, 0x80});                     // lea r12d, [rax + rax * 4]
+            break;
+
+        case OP_00EE:
+            jit_emit_mem(jit, {0x48, 0x8B}, JIT_EAX, JIT_OFF(stack_ptr)); // mov rax, [stack_ptr]
+            jit_emit(jit, {0x48, 0x83, 0xE8, 0x02});                     // sub rax, 2
+            jit_emit_mem(jit, {0x48, 0x89}, JIT_EAX, JIT_OFF(stack_ptr)); // mov [stack_ptr], rax
+            jit_emit(jit, {0x0F, 0xB7, 0x00});                           // movzx eax, word [rax]
+            jit_emit_mem(jit, {0x66, 0x89}, JIT_EAX, JIT_OFF(PC));       // mov [PC], ax
+            break;
+        case OP_1NNN: // mov word [PC], NNN
+            jit_emit_mem(jit, {0x66, 0xC7}, 0, JIT_OFF(PC)); jit_emit16(jit, inst.NNN);
+            break;
+        case OP_2NNN:
+            jit_emit_mem(jit, {0x48, 0x8B}, JIT_EAX, JIT_OFF(stack_ptr)); // mov rax, [stack_ptr]
+            jit_emit(jit, {0x66, 0xC7, 0x00}); jit_emit16(jit, next_pc);  // mov word [rax], next_pc
+            jit_emit(jit, {0x48, 0x83, 0xC0, 0x02});                     // add rax, 2
+            jit_emit_mem(jit, {0x48, 0x89}, JIT_EAX, JIT_OFF(stack_ptr)); // mov [stack_ptr], rax
+            jit_emit_mem(jit, {0x66, 0xC7}, 0, JIT_OFF(PC)); jit_emit16(jit, inst.NNN); // mov word [PC], NNN
+            break;
+        case OP_BNNN:
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_EAX, JIT_V(QUIRKS::jump_uses_vx ? inst.X : 0)); // movzx eax, [V0] (or [VX])
+            jit_emit(jit, {0x05}); jit_emit32(jit, inst.NNN);            // add eax, NNN
+            jit_emit_mem(jit, {0x66, 0x89}, JIT_EAX, JIT_OFF(PC));       // mov [PC], ax
+            break;
+        case OP_3XNN: case OP_4XNN:
+            jit_emit_mem(jit, {0x80}, 7, JIT_V(inst.X)); jit_emit(jit, {inst.NN}); // cmp byte [VX], NN
+            jit_emit_skip(jit, next_pc, skip_pc, op == OP_3XNN);
+            break;
+        case OP_5XY0: case OP_9XY0:
+            jit_emit_mem(jit, {0x8A}, JIT_EAX, JIT_V(inst.X));           // mov al, [VX]
+            jit_emit_mem(jit, {0x3A}, JIT_EAX, JIT_V(inst.Y));           // cmp al, [VY]
+            jit_emit_skip(jit, next_pc, skip_pc, op == OP_5XY0);
+            break;
+        case OP_EX9E: case OP_EXA1:
+            jit_emit_mem(jit, {0x0F, 0xB6}, JIT_EAX, JIT_V(inst.X));     // movzx eax, [VX]
+            jit_emit(jit, {0x80, 0xBC, 0x03}); jit_emit32(jit, JIT_OFF(keypad)); jit_emit(jit, {0x00}); // cmp byte [rbx + rax + keypad], 0
+            jit_emit_skip(jit, next_pc, skip_pc, op == OP_EXA1);                  // 9E skips when pressed (ne), A1 when released (eq)
+            break;
+        default: break;
+    }
+}
+
+// Forget every translated block and reuse the code buffer from the start
+static void jit_flush(JIT_T *jit) {
+    memset(jit->blocks, 0, jit->memory_size * sizeof *jit->blocks);
+    jit->code_ptr = jit->code;
+    jit->block_count = 0;
+}
+
+// Placeholder for addresses whose first opcode the JIT can't translate; never fits any budget
+static JIT_BLOCK_T jit_interpret_block = {nullptr, 2, UINT32_MAX, false};
+
+// Translate the basic block starting at PC; returns the placeholder if its first opcode isn't supported
+template <typename QUIRKS>
+static JIT_BLOCK_T *jit_compile(CHIP_8 *chip8, const uint16_t start) {
+    JIT_T *jit = chip8->jit;
+    if (jit->block_count == JIT_MAX_BLOCKS || jit->code_ptr + JIT_MAX_BLOCK_CODE > jit->code + JIT_CODE_SIZE)
+        jit_flush(jit); // Out of room, start over
+
+    uint8_t *const entry = jit->code_ptr;
+    uint32_t addr = start;          // Past 0xFFFF only once the last XO-CHIP opcode is in
+    uint32_t count = 0;
+    bool ends_block = false;
+
+    jit_emit(jit, {0x53, 0x41, 0x54});                                   // push rbx; push r12
+#ifdef _WIN32
+    jit_emit(jit, {0x48, 0x89, 0xCB});                                   // mov rbx, rcx
+#else
+    jit_emit(jit, {0x48, 0x89, 0xFB});                                   // mov rbx, rdi
+#endif
+    jit_emit_mem(jit, {0x44, 0x0F, 0xB7}, 4, JIT_OFF(I));                // movzx r12d, word [I]
+
+    uint32_t bytes = 0;             // RAM the block depends on; an XO-CHIP skip reads the opcode after it too
+    while (!ends_block && count < JIT_MAX_BLOCK_LENGTH && addr < QUIRKS::memory_size - 1) {
+        const INSTRUCTION_T inst = decode_operands((chip8->ram[addr] << 8) | chip8->ram[addr + 1]);
+        const OPCODE_T op = decode_opcode(inst);
+        if (!jit_supported(op, &ends_block)) break;
+        const uint16_t next_pc = addr + 2;
+        const bool long_skip = QUIRKS::xochip && chip8->ram[next_pc] == 0xF0 && chip8->ram[ram_address<QUIRKS>(next_pc + 1)] == 0x00;
+        jit_emit_opcode<QUIRKS>(jit, op, inst, addr, next_pc + (long_skip ? 4 : 2));
+        addr += 2;
+        bytes = addr - start + (QUIRKS::xochip && ends_block ? 2 : 0);
+        count++;
+    }
+
+    if (count == 0) {
+        jit->code_ptr = entry;
+        return jit->blocks[start] = &jit_interpret_block;
+    }
+
+    if (!ends_block) { jit_emit_mem(jit, {0x66, 0xC7}, 0, JIT_OFF(PC)); jit_emit16(jit, addr); } // Fall through: mov word [PC], addr
+    jit_emit_mem(jit, {0x66, 0x44, 0x89}, 4, JIT_OFF(I));                // mov [I], r12w
+    jit_emit(jit, {0x41, 0x5C, 0x5B, 0xC3});                             // pop r12; pop rbx; ret
+
+    JIT_BLOCK_T *block = &jit->block_pool[jit->block_count++];
+    block->fn = (JIT_BLOCK_FN_T)entry;
+    block->bytes = bytes;
+    block->count = count;
+    block->loop_head = idle_loop_length(chip8, start) != 0;
+    return jit->blocks[start] = block;
+}
+
+// Drop translated blocks overlapping a RAM write
+void jit_invalidate(JIT_T *jit, const uint32_t address, const uint32_t length) {
+    const uint32_t first = address > JIT_MAX_BLOCK_BYTES ? address - JIT_MAX_BLOCK_BYTES : 0;
+    for (uint32_t start = first; start < address + length && start < jit->memory_size; start++) {
+        const JIT_BLOCK_T *block = jit->blocks[start];
+        if (block && start + block->bytes > address) jit->blocks[start] = nullptr;
+    }
+}
+
+// Allocate executable memory for the code buffer and a block slot per address of memory_size
+static JIT_T *jit_create(const uint32_t memory_size) {
+    JIT_T *jit = (JIT_T *)calloc(1, sizeof(JIT_T));
+    if (!jit) return nullptr;
+    jit->memory_size = memory_size;
+    if (!(jit->blocks = (JIT_BLOCK_T **)calloc(memory_size, sizeof *jit->blocks))) {
+        free(jit);
+        return nullptr;
+    }
+#ifdef _WIN32
+    jit->code = (uint8_t *)VirtualAlloc(nullptr, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    jit->code = (uint8_t *)mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED) jit->code = nullptr;
+#endif
+    if (!jit->code) {
+        SDL_Log("Could not allocate JIT code buffer");
+        free(jit->blocks);
+        free(jit);
+        return nullptr;
+    }
+    jit->code_ptr = jit->code;
+    return jit;
+}
+
+// Release the JIT and its code buffer
+void jit_destroy(CHIP_8 *chip8) {
+    if (!chip8->jit) return;
+#ifdef _WIN32
+    VirtualFree(chip8->jit->code, 0, MEM_RELEASE);
+#else
+    munmap(chip8->jit->code, JIT_CODE_SIZE);
+#endif
+    free(chip8->jit->blocks);
+    free(chip8->jit);
+    chip8->jit = nullptr;
+}
+
+// Emulate chip8->cycles instructions, running translated blocks where they fit the remaining budget
+template <typename QUIRKS>
+void run_jit(CHIP_8 *chip8, const CONFIG_T &config) {
+    if (!chip8->jit && !(chip8->jit = jit_create(QUIRKS::memory_size))) {
+        run_switch<QUIRKS>(chip8, config); // No executable memory, interpret
+        return;
+    }
+
+    while (chip8->cycles) {
+        const uint16_t PC = chip8->PC;
+        if (PC < QUIRKS::memory_size - 1) {
+            JIT_BLOCK_T *block = chip8->jit->blocks[PC];
+            if (!block) block = jit_compile<QUIRKS>(chip8, PC);
+            if (block->loop_head) {
+                skip_idle_loop(chip8);
+                if (!chip8->cycles) break;
+            }
+            if (block->count <= chip8->cycles) {
+                chip8->cycles -= block->count;
+                block->fn(chip8);
+                continue;
+            }
+        }
+        chip8->cycles--;
+        emulate_instructions<QUIRKS>(chip8, config); // Unsupported opcode, or block longer than what's left of the budget
+    }
+}
+#endif
+
+#ifdef CHIP8_AOT
+// Index the precompiled blocks; left empty if the loaded ROM or quirk set isn't the one chip8-aot compiled
+static AOT_T *aot_create(const CHIP_8 *chip8) {
+    AOT_T *aot = (AOT_T *)calloc(1, sizeof(AOT_T));
+    if (!aot) return nullptr;
+    aot->memory_size = memory_size(chip8->extension);
+    aot->blocks = (const AOT_BLOCK_T **)calloc(aot->memory_size, sizeof *aot->blocks);
+    aot->loop_head = (bool *)calloc(aot->memory_size, sizeof *aot->loop_head);
+    if (!aot->blocks || !aot->loop_head) {
+        free(aot->blocks);
+        free(aot->loop_head);
+        free(aot);
+        return nullptr;
+    }
+
+    if (chip8->extension != aot_extension) {
+        SDL_Log("Precompiled ROM was built for another extension, interpreting instead");
+        return aot;
+    }
+    if (aot_rom_size > aot->memory_size - 0x200 || memcmp(&chip8->ram[0x200], aot_rom, aot_rom_size) != 0) {
+        SDL_Log("ROM %s does not match the precompiled ROM, interpreting instead", chip8->rom_name);
+        return aot;
+    }
+    for (uint32_t i = 0; i < aot_block_count; i++) {
+        aot->blocks[aot_blocks[i].address] = &aot_blocks[i];
+        aot->loop_head[aot_blocks[i].address] = idle_loop_length(chip8, aot_blocks[i].address) != 0;
+    }
+    return aot;
+}
+
+// Release the AOT block index
+void aot_destroy(CHIP_8 *chip8) {
+    if (!chip8->aot) return;
+    free(chip8->aot->blocks);
+    free(chip8->aot->loop_head);
+    free(chip8->aot);
+    chip8->aot = nullptr;
+}
+
+// Emulate chip8->cycles instructions, running precompiled blocks where they fit the remaining budget
+template <typename QUIRKS>
+void run_aot(CHIP_8 *chip8, const CONFIG_T &config) {
+    if (!chip8->aot) chip8->aot = aot_create(chip8);
+
+    while (chip8->cycles) {
+        // Computed jumps (BNNN), overwritten code and addresses chip8-aot never reached are interpreted
+        const AOT_BLOCK_T *block = chip8->aot && chip8->PC < QUIRKS::memory_size ? chip8->aot->blocks[chip8->PC] : nullptr;
+        if (block && chip8->aot->loop_head[chip8->PC]) {
+            skip_idle_loop(chip8);
+            if (!chip8->cycles) break;
+        }
+        if (block && block->count <= chip8->cycles) {
+            chip8->cycles -= block->count; // Charged up front: a key wait ending the block zeroes the budget
+            block->fn(chip8, config);
+        } else {
+            chip8->cycles--;
+            emulate_instructions<QUIRKS>(chip8, config);
+        }
+    }
+}
+#endif
+
+// ---------------------------------------------------------------------------------------------
+// Lockstep engine. Each step runs one instruction on every lane: the first pending lane's PC and
+// opcode pick a group, every pending lane at the same PC holding the same opcode joins it, and the
+// handler is applied to the whole group under a byte mask (0xFF per member lane). Lanes left out
+// form the next group of the same step. Lane loops are plain loops over LANES for the vectoriser;
+// lockstep_steps is compiled once per LOCKSTEP_ISA_T under a target attribute and the build is
+// picked at runtime. There are no intrinsics: the AVX builds are whatever the auto-vectoriser makes of them.
+// ---------------------------------------------------------------------------------------------
+
+#ifdef CHIP8_HAS_LOCKSTEP_AVX
+#define LOCKSTEP_INLINE inline __attribute__((always_inline)) // Inherit the target of the ISA wrapper
+#else
+#define LOCKSTEP_INLINE inline
+#endif
+
+// DXYN on one lane, same drawing rules as op_DXYN
+template <typename QUIRKS, uint32_t LANES>
+static void lockstep_draw(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, const INSTRUCTION_T inst, const uint32_t l) {
+    (void)config;
+    const uint8_t X_coord = group->V[inst.X][l] % LORES_WIDTH;
+    const uint8_t Y_coord = group->V[inst.Y][l] % LORES_HEIGHT;
+    uint64_t *const display = group->display[l];
+    uint64_t collision = 0;
+
+    for (uint8_t i = 0; i < inst.N; i++) {
+        if (QUIRKS::clip_sprites && Y_coord + i >= LORES_HEIGHT) break;
+        const uint64_t sprite_data = (uint64_t)group->ram[(group->I[l] + i) & 0xFFF][l] << (LORES_WIDTH - 8);
+        const uint64_t sprite_row = QUIRKS::clip_sprites ? sprite_data >> X_coord : std::rotr(sprite_data, X_coord);
+        uint64_t *row = &display[(Y_coord + i) % LORES_HEIGHT];
+        collision |= *row & sprite_row;
+        *row ^= sprite_row;
+    }
+    group->V[0xF][l] = collision != 0;
+}
+
+// Run one opcode on the lanes with m[l] == 0xFF. Mirrors the op_* handlers; ops that index per-lane
+// memory (stack, RAM, display) loop over member lanes, the rest are branch-free blends. Register
+// rows are worked on in local copies: uint8_t rows may alias anything, and the vectoriser won't
+// add runtime alias checks at -O2
+template <typename QUIRKS, uint32_t LANES>
+static LOCKSTEP_INLINE void lockstep_execute(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, const INSTRUCTION_T inst,
+                                             const OPCODE_T op, const uint8_t *mask) {
+    alignas(64) uint8_t m[LANES], x[LANES], y[LANES], f[LANES];
+    alignas(64) uint16_t pc[LANES];
+    memcpy(m, mask, sizeof m);
+    memcpy(x, group->V[inst.X], sizeof x);
+    memcpy(y, group->V[inst.Y], sizeof y);
+    memcpy(f, group->V[0xF], sizeof f);
+    memcpy(pc, group->PC, sizeof pc);
+    bool store_x = false, store_f = false;
+
+    for (uint32_t l = 0; l < LANES; l++) pc[l] += m[l] & 2; // Past the opcode, as the fetch does
+
+    switch (op) {
+        case OP_00E0:
+            for (uint32_t l = 0; l < LANES; l++) if (m[l]) memset(group->display[l], false, sizeof group->display[l]);
+            break;
+        case OP_00EE:
+            for (uint32_t l = 0; l < LANES; l++) if (m[l]) pc[l] = group->stack[--group->stack_depth[l]][l];
+            break;
+        case OP_1NNN:
+            for (uint32_t l = 0; l < LANES; l++) pc[l] = m[l] ? inst.NNN : pc[l];
+            break;
+        case OP_2NNN:
+            for (uint32_t l = 0; l < LANES; l++) if (m[l]) {
+                group->stack[group->stack_depth[l]++][l] = pc[l];
+                pc[l] = inst.NNN;
+            } break;
+        case OP_3XNN: for (uint32_t l = 0; l < LANES; l++) pc[l] += m[l] & (x[l] == inst.NN ? 2 : 0); break;
+        case OP_4XNN: for (uint32_t l = 0; l < LANES; l++) pc[l] += m[l] & (x[l] != inst.NN ? 2 : 0); break;
+        case OP_5XY0: for (uint32_t l = 0; l < LANES; l++) pc[l] += m[l] & (x[l] == y[l] ? 2 : 0); break;
+        case OP_9XY0: for (uint32_t l = 0; l < LANES; l++) pc[l] += m[l] & (x[l] != y[l] ? 2 : 0); break;
+        case OP_6XNN:
+            for (uint32_t l = 0; l < LANES; l++) x[l] = m[l] ? inst.NN : x[l];
+            store_x = true;
+            break;
+        case OP_7XNN:
+            for (uint32_t l = 0; l < LANES; l++) x[l] += m[l] & inst.NN;
+            store_x = true;
+            break;
+        case OP_8XY0:
+            for (uint32_t l = 0; l < LANES; l++) x[l] = m[l] ? y[l] : x[l];
+            store_x = true;
+            break;
+        case OP_8XY1: case OP_8XY2: case OP_8XY3:
+            for (uint32_t l = 0; l < LANES; l++) {
+                const uint8_t result = op == OP_8XY1 ? x[l] | y[l] : op == OP_8XY2 ? x[l] & y[l] : x[l] ^ y[l];
+                x[l] = m[l] ? result : x[l];
+                if constexpr (QUIRKS::vf_reset) f[l] &= ~m[l];
+            }
+            store_x = true;
+            store_f = QUIRKS::vf_reset;
+            break;
+        case OP_8XY4:
+            for (uint32_t l = 0; l < LANES; l++) {
+                const uint8_t result = x[l] + y[l];
+                const uint8_t carry = result < x[l];
+                x[l] = m[l] ? result : x[l];
+                f[l] = m[l] ? carry : f[l];
+            }
+            store_x = store_f = true;
+            break;
+        case OP_8XY5:
+            for (uint32_t l = 0; l < LANES; l++) {
+                const uint8_t result = x[l] - y[l];
+                const uint8_t carry = y[l] <= x[l];
+                x[l] = m[l] ? result : x[l];
+                f[l] = m[l] ? carry : f[l];
+            }
+            store_x = store_f = true;
+            break;
+        case OP_8XY7:
+            for (uint32_t l = 0; l < LANES; l++) {
+                const uint8_t result = y[l] - x[l];
+                const uint8_t carry = x[l] <= y[l];
+                x[l] = m[l] ? result : x[l];
+                f[l] = m[l] ? carry : f[l];
+            }
+            store_x = store_f = true;
+            break;
+        case OP_8XY6:
+            for (uint32_t l = 0; l < LANES; l++) {
+                const uint8_t source = QUIRKS::shift_uses_vy ? y[l] : x[l];
+                x[l] = m[l] ? source >> 1 : x[l];
+                f[l] = m[l] ? source & 1 : f[l];
+            }
+            store_x = store_f = true;
+            break;
+        case OP_8XYE:
+            for (uint32_t l = 0; l < LANES; l++) {
+                const uint8_t source = QUIRKS::shift_uses_vy ? y[l] : x[l];
+                x[l] = m[l] ? (uint8_t)(source << 1) : x[l];
+                f[l] = m[l] ? source >> 7 : f[l];
+            }
+            store_x = store_f = true;
+            break;
+        case OP_ANNN: for (uint32_t l = 0; l < LANES; l++) group->I[l] = m[l] ? inst.NNN : group->I[l]; break;
+        case OP_BNNN:
+            for (uint32_t l = 0; l < LANES; l++) pc[l] = m[l] ? group->V[QUIRKS::jump_uses_vx ? inst.X : 0][l] + inst.NNN : pc[l];
+            break;
+        case OP_CXNN:
+            for (uint32_t l = 0; l < LANES; l++) {
+                uint32_t rng = group->rng[l];
+                rng ^= rng << 13;
+                rng ^= rng >> 17;
+                rng ^= rng << 5;
+                group->rng[l] = m[l] ? rng : group->rng[l];
+                x[l] = m[l] ? (rng >> 24) & inst.NN : x[l];
+            }
+            store_x = true;
+            break;
+        case OP_DXYN:
+            for (uint32_t l = 0; l < LANES; l++) if (m[l]) lockstep_draw<QUIRKS, LANES>(group, config, inst, l);
+            break;
+        case OP_EX9E: case OP_EXA1:
+            for (uint32_t l = 0; l < LANES; l++) {
+                const bool pressed = x[l] < 16 && ((group->keypad[l] >> x[l]) & 1);
+                pc[l] += m[l] & (pressed == (op == OP_EX9E) ? 2 : 0);
+            } break;
+        case OP_FX07:
+            for (uint32_t l = 0; l < LANES; l++) x[l] = m[l] ? group->delay_timer[l] : x[l];
+            store_x = true;
+            break;
+        case OP_FX0A:
+            for (uint32_t l = 0; l < LANES; l++) if (m[l]) {
+                if (!group->anykey_pressed[l] && group->keypad[l]) {
+                    group->key[l] = countr_zero(group->keypad[l]); // Lowest key down, as op_FX0A's scan finds first
+                    group->anykey_pressed[l] = true;
+                }
+                if (!group->anykey_pressed[l] || ((group->keypad[l] >> group->key[l]) & 1)) pc[l] -= 2; // Wait for press, then release
+                else {
+                    x[l] = group->key[l];
+                    group->anykey_pressed[l] = false;
+                }
+            }
+            store_x = true;
+            break;
+        case OP_FX15: {
+            alignas(64) uint8_t delay_timer[LANES];
+            memcpy(delay_timer, group->delay_timer, sizeof delay_timer);
+            for (uint32_t l = 0; l < LANES; l++) delay_timer[l] = m[l] ? x[l] : delay_timer[l];
+            memcpy(group->delay_timer, delay_timer, sizeof delay_timer);
+            break;
+        }
+        case OP_FX1E: for (uint32_t l = 0; l < LANES; l++) group->I[l] += m[l] ? x[l] : 0; break;
+        case OP_FX29: for (uint32_t l = 0; l < LANES; l++) group->I[l] = m[l] ? x[l] * 5 : group->I[l]; break;
+        case OP_FX33:
+            for (uint32_t l = 0; l < LANES; l++) if (m[l]) {
+                const uint16_t I = group->I[l];
+                group->ram[I & 0xFFF][l] = x[l] / 100;
+                group->ram[(I + 1) & 0xFFF][l] = x[l] / 10 % 10;
+                group->ram[(I + 2) & 0xFFF][l] = x[l] % 10;
+            } break;
+        case OP_FX55: case OP_FX65: // Straight on group->V: every register up to X may change
+            for (uint32_t l = 0; l < LANES; l++) if (m[l]) {
+                for (uint8_t i = 0; i <= inst.X; i++) {
+                    uint8_t &cell = group->ram[(group->I[l] + i) & 0xFFF][l];
+                    if (op == OP_FX55) cell = group->V[i][l];
+                    else group->V[i][l] = cell;
+                }
+                if constexpr (QUIRKS::load_store_increments_i) group->I[l] += inst.X + 1;
+            } break;
+        case OP_FX18: break; // Lanes make no sound, so there is no sound timer to set
+        default: break; // Invalid opcodes are ignored, as op_invalid does
+    }
+
+    // VF last, so a flag result wins over a VF destination the way it does in the op_* handlers
+    if (store_x) memcpy(group->V[inst.X], x, sizeof x);
+    if (store_f) memcpy(group->V[0xF], f, sizeof f);
+    memcpy(group->PC, pc, sizeof pc);
+}
+
+// idle_loop_length on one lane's RAM
+template <uint32_t LANES>
+static uint32_t lockstep_idle_loop_length(const LOCKSTEP_T<LANES> *group, const uint32_t l, const uint16_t PC) {
+    if (PC > 4096 - 6) return 0;
+    uint8_t op[6];
+    for (uint32_t i = 0; i < 6; i++) op[i] = group->ram[PC + i][l];
+    const uint8_t X = op[0] & 0x0F;
+
+    if ((op[0] >> 4) == 0x1 && ((X << 8) | op[1]) == PC) return 1;
+    if ((op[0] >> 4) == 0xF && op[1] == 0x07 && op[2] == (0x30 | X) &&
+        (op[4] >> 4) == 0x1 && (((op[4] & 0x0F) << 8) | op[5]) == PC) return 3;
+    return 0;
+}
+
+// Does any lane have m[l] set? A reduction the vectoriser turns into a few ORs
+template <uint32_t LANES>
+static LOCKSTEP_INLINE bool lockstep_any(const uint8_t *m) {
+    uint8_t any = 0;
+    for (uint32_t l = 0; l < LANES; l++) any |= m[l];
+    return any;
+}
+
+// Park the lanes of m that a jump to NNN left in an idle loop. Lanes whose six bytes at NNN match
+// the lead lane's share its idle_loop_length; only lanes running different code there are checked alone
+template <uint32_t LANES>
+static LOCKSTEP_INLINE bool lockstep_park(LOCKSTEP_T<LANES> *group, const uint8_t *m, const uint32_t lead,
+                                          const uint16_t NNN, const uint32_t count, uint32_t *resume) {
+    if (NNN > 4096 - 6) return false;
+    alignas(64) uint8_t same[LANES];
+    memcpy(same, m, sizeof same);
+    for (uint32_t i = 0; i < 6; i++) {
+        const uint8_t *row = group->ram[NNN + i];
+        const uint8_t lead_byte = row[lead];
+        for (uint32_t l = 0; l < LANES; l++) same[l] &= -(uint8_t)(row[l] == lead_byte);
+    }
+    const uint32_t lead_length = lockstep_idle_loop_length(group, lead, NNN);
+    if (!lead_length) {
+        bool others = false;
+        for (uint32_t l = 0; l < LANES; l++) others |= m[l] && !same[l];
+        if (!others) return false; // The usual case: every lane ran the same code into an ordinary jump
+    }
+
+    bool parked = false;
+    for (uint32_t l = 0; l < LANES; l++) {
+        if (!m[l]) continue;
+        switch (same[l] ? lead_length : lockstep_idle_loop_length(group, l, NNN)) {
+            case 1: resume[l] = 0; parked = true; break;
+            case 3: {
+                const uint8_t X = group->ram[NNN][l] & 0x0F;
+                if (group->delay_timer[l] == group->ram[NNN + 3][l] || count - 1 < 3) break;
+                group->V[X][l] = group->delay_timer[l];
+                resume[l] = (count - 1) % 3;
+                parked = true;
+                break;
+            }
+            default: break;
+        }
+    }
+    return parked;
+}
+
+template <typename QUIRKS, uint32_t LANES>
+static LOCKSTEP_INLINE void lockstep_steps(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, uint32_t count) {
+    // Lanes a jump left in an idle loop sit out until count falls to their resume value, the way
+    // skip_idle_loop shortens a scalar batch; wake is the highest resume value of any lane
+    alignas(64) uint32_t resume[LANES];
+    for (uint32_t l = 0; l < LANES; l++) resume[l] = UINT32_MAX;
+    uint32_t wake = UINT32_MAX;
+    bool parked = false;
+
+    for (; count; count--) {
+        if (count > wake && !(count = wake)) break; // Every lane idle for the rest of the run
+
+        alignas(64) uint8_t pending[LANES];
+        uint32_t lead = 0;
+        if (!parked) memset(pending, 0xFF, sizeof pending);
+        else {
+            for (uint32_t l = 0; l < LANES; l++) pending[l] = -(uint8_t)(count <= resume[l]);
+            while (!pending[lead]) lead++; // count <= wake, so some lane is pending
+        }
+
+        for (;;) {
+            // Group: pending lanes at the lead lane's PC holding the same opcode there
+            const uint16_t PC = group->PC[lead] & 0xFFF;
+            const uint8_t *const hi_row = group->ram[PC], *const lo_row = group->ram[(PC + 1) & 0xFFF];
+            const uint8_t hi = hi_row[lead], lo = lo_row[lead];
+            alignas(64) uint8_t m[LANES];
+            for (uint32_t l = 0; l < LANES; l++)
+                m[l] = pending[l] & -(uint8_t)(((group->PC[l] & 0xFFF) == PC) & (hi_row[l] == hi) & (lo_row[l] == lo));
+            for (uint32_t l = 0; l < LANES; l++) pending[l] &= ~m[l];
+
+            const INSTRUCTION_T inst = decode_operands(hi << 8 | lo);
+            const OPCODE_T op = decode_opcode(inst);
+            lockstep_execute<QUIRKS, LANES>(group, config, inst, op, m);
+
+            // Jumps are where idle loops close, as in op_1NNN
+            if (op == OP_1NNN && lockstep_park(group, m, lead, inst.NNN, count, resume)) {
+                parked = true;
+                wake = 0;
+                for (uint32_t l = 0; l < LANES; l++) wake = resume[l] > wake ? resume[l] : wake;
+            }
+
+            if (!lockstep_any<LANES>(pending)) break;
+            while (!pending[lead]) lead++;
+        }
+    }
+}
+
+template <typename QUIRKS, uint32_t LANES>
+static void lockstep_scalar(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, const uint32_t count) {
+    lockstep_steps<QUIRKS, LANES>(group, config, count);
+}
+
+#ifdef CHIP8_HAS_LOCKSTEP_AVX
+template <typename QUIRKS, uint32_t LANES>
+__attribute__((target("avx2"))) static void lockstep_avx2(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, const uint32_t count) {
+    lockstep_steps<QUIRKS, LANES>(group, config, count);
+}
+
+template <typename QUIRKS, uint32_t LANES>
+__attribute__((target("avx512f,avx512bw"))) static void lockstep_avx512(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, const uint32_t count) {
+    lockstep_steps<QUIRKS, LANES>(group, config, count);
+}
+#endif
+
+template <typename QUIRKS, uint32_t LANES>
+static void lockstep_dispatch(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, const uint32_t count) {
+    switch (group->isa) {
+#ifdef CHIP8_HAS_LOCKSTEP_AVX
+        case LOCKSTEP_AVX512: lockstep_avx512<QUIRKS, LANES>(group, config, count); break;
+        case LOCKSTEP_AVX2: lockstep_avx2<QUIRKS, LANES>(group, config, count); break;
+#endif
+        default: lockstep_scalar<QUIRKS, LANES>(group, config, count); break;
+    }
+}
+
+template <uint32_t LANES>
+bool lockstep_run(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, const uint32_t count) {
+    if (config.current_ex != CHIP8) { // Lanes hold 4 KB and one lo-res plane, and the kernels implement CHIP-8 quirks
+        SDL_Log("Lockstep runs CHIP-8 quirks only");
+        return false; }
+    lockstep_dispatch<QUIRKS_T<CHIP8>, LANES>(group, config, count);
+    return true;
+}
+
+template <uint32_t LANES>
+void lockstep_load(LOCKSTEP_T<LANES> *group, const uint32_t lane, const CHIP_8 *chip8) {
+    for (uint32_t x = 0; x < 16; x++) group->V[x][lane] = chip8->V[x];
+    group->PC[lane] = chip8->PC;
+    group->I[lane] = chip8->I;
+    group->delay_timer[lane] = chip8->delay_timer;
+    group->keypad[lane] = 0;
+    for (uint32_t k = 0; k < 16; k++) group->keypad[lane] |= chip8->keypad[k] << k;
+    group->stack_depth[lane] = (uint8_t)(chip8->stack_ptr - chip8->stack);
+    for (uint32_t i = 0; i < STACK_DEPTH; i++) group->stack[i][lane] = chip8->stack[i];
+    group->rng[lane] = chip8->rng;
+    group->anykey_pressed[lane] = chip8->anykey_pressed;
+    group->key[lane] = chip8->key;
+    for (uint32_t address = 0; address < sizeof group->ram / sizeof group->ram[0]; address++) group->ram[address][lane] = chip8->ram[address];
+    for (uint32_t y = 0; y < LORES_HEIGHT; y++) group->display[lane][y] = chip8->display[0][y][0];
+}
+
+template <uint32_t LANES>
+bool lockstep_init(LOCKSTEP_T<LANES> *group, const char rom_name[]) {
+    CHIP_8 chip8 = {}; // Loads and checks the ROM exactly as a single machine would
+    const bool loaded = init_chip8(&chip8, rom_name, CHIP8);
+    if (loaded) lockstep_load_all(group, &chip8);
+    destroy_chip8(&chip8);
+    return loaded;
+}
+
+template <uint32_t LANES>
+void lockstep_load_all(LOCKSTEP_T<LANES> *group, const CHIP_8 *chip8) {
+    for (uint32_t l = 0; l < LANES; l++) lockstep_load(group, l, chip8);
+#ifdef CHIP8_HAS_LOCKSTEP_AVX
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) group->isa = LOCKSTEP_AVX512;
+    else if (__builtin_cpu_supports("avx2")) group->isa = LOCKSTEP_AVX2;
+    else group->isa = LOCKSTEP_SCALAR;
+#else
+    group->isa = LOCKSTEP_SCALAR;
+#endif
+}
+
+template <uint32_t LANES>
+void lockstep_update_timers(LOCKSTEP_T<LANES> *group) {
+    for (uint32_t l = 0; l < LANES; l++) group->delay_timer[l] -= group->delay_timer[l] > 0;
+}
+
+#define X(lanes) \
+    template bool lockstep_init<lanes>(LOCKSTEP_T<lanes> *group, const char rom_name[]); \
+    template void lockstep_load_all<lanes>(LOCKSTEP_T<lanes> *group, const CHIP_8 *chip8); \
+    template void lockstep_load<lanes>(LOCKSTEP_T<lanes> *group, uint32_t lane, const CHIP_8 *chip8); \
+    template bool lockstep_run<lanes>(LOCKSTEP_T<lanes> *group, const CONFIG_T &config, uint32_t count); \
+    template void lockstep_update_timers<lanes>(LOCKSTEP_T<lanes> *group);
+X(8) X(16) X(32)
+#undef X
+
+struct RECORDER_T {
+    void *base;                 // Mapped file
+    size_t size;
+    RECORD_HEADER_T *header;
+    RECORD_T *records;
+};
+
+// Create path as an empty trace ring of capacity records and map it
+RECORDER_T *record_open(const char *path, const uint32_t capacity) {
+    const size_t size = sizeof(RECORD_HEADER_T) + (size_t)capacity * sizeof(RECORD_T);
+    void *base = nullptr;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+        if (mapping) {
+            base = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+            CloseHandle(mapping); // The view keeps the mapping alive
+        }
+        CloseHandle(file);
+    }
+#else
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (ftruncate(fd, (off_t)size) == 0) {
+            base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) base = nullptr;
+        }
+        close(fd); // The mapping keeps the file open
+    }
+#endif
+    if (!base) {
+        SDL_Log("Could not map trace file %s: %s", path, strerror(errno));
+        return nullptr;
+    }
+
+    RECORDER_T *recorder = (RECORDER_T *)calloc(1, sizeof(RECORDER_T));
+    if (!recorder) {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(base, size);
+#endif
+        return nullptr;
+    }
+    recorder->base = base;
+    recorder->size = size;
+    recorder->header = (RECORD_HEADER_T *)base;
+    recorder->records = (RECORD_T *)(recorder->header + 1);
+    *recorder->header = (RECORD_HEADER_T) {
+            .magic = RECORD_MAGIC,
+            .version = RECORD_VERSION,
+            .record_size = sizeof(RECORD_T),
+            .capacity = capacity,
+    };
+    return recorder;
+}
+
+// Flush and unmap the trace ring
+void record_close(CHIP_8 *chip8) {
+    RECORDER_T *recorder = chip8->recorder;
+    if (!recorder) return;
+#ifdef _WIN32
+    FlushViewOfFile(recorder->base, recorder->size);
+    UnmapViewOfFile(recorder->base);
+#else
+    msync(recorder->base, recorder->size, MS_SYNC);
+    munmap(recorder->base, recorder->size);
+#endif
+    free(recorder);
+    chip8->recorder = nullptr;
+}
+
+// Append the instruction just executed; V and I are the registers from before it ran
+static void record_instruction(RECORDER_T *recorder, const CHIP_8 *chip8, const uint16_t PC, const uint8_t *V, const uint16_t I) {
+    RECORD_HEADER_T *header = recorder->header;
+    RECORD_T *record = &recorder->records[header->total % header->capacity];
+    record->counter = header->total;
+    record->PC = PC;
+    record->opcode = chip8->inst.opcode;
+    record->changed = RECORD_NONE;
+    record->value = 0;
+
+    // Prefer the destination register; VF as a flag only when nothing else changed
+    const uint8_t X = chip8->inst.X;
+    if (chip8->I != I) {
+        record->changed = RECORD_I;
+        record->value = chip8->I;
+    } else if (chip8->V[X] != V[X]) {
+        record->changed = X;
+        record->value = chip8->V[X];
+    } else {
+        for (uint8_t i = 0; i < 16; i++) {
+            if (chip8->V[i] == V[i]) continue;
+            record->changed = i;
+            record->value = chip8->V[i];
+            break;
+        }
+    }
+    header->total++;
+}
+
+// Count the instruction just executed from PC
+static void profile_instruction(PROFILER_T *profiler, const uint16_t PC, const INSTRUCTION_T &inst) {
+    const OPCODE_T op = decode_opcode(inst);
+    profiler->op_counts[op]++;
+    if (PC < profiler->memory_size) {
+        profiler->pc_counts[PC]++;
+        profiler->pc_ops[PC] = op;
+    }
+}
+
+// Charge the time since *mark to phase. Each thread keeps its own mark and charges its own phases
+static void profile_phase(PROFILER_T *profiler, const PROFILE_PHASE_T phase, uint64_t *mark) {
+    if (!profiler) return;
+    const uint64_t now = SDL_GetPerformanceCounter();
+    profiler->phase_ticks[phase] += now - *mark;
+    *mark = now;
+}
+
+#ifndef CHIP8_NO_MAIN // Only main sets up and writes a profile
+// Profiler with per-address counts for memory_size addresses, the quirk set's memory
+static PROFILER_T *profile_create(const uint32_t memory_size) {
+    PROFILER_T *profiler = (PROFILER_T *)calloc(1, sizeof(PROFILER_T));
+    if (!profiler) return nullptr;
+    profiler->memory_size = memory_size;
+    profiler->pc_counts = (uint64_t *)calloc(memory_size, sizeof *profiler->pc_counts);
+    profiler->pc_ops = (OPCODE_T *)calloc(memory_size, sizeof *profiler->pc_ops);
+    if (!profiler->pc_counts || !profiler->pc_ops) {
+        free(profiler->pc_counts);
+        free(profiler->pc_ops);
+        free(profiler);
+        return nullptr;
+    }
+    return profiler;
+}
+
+static void profile_destroy(PROFILER_T *profiler) {
+    free(profiler->pc_counts);
+    free(profiler->pc_ops);
+    free(profiler);
+}
+
+static const char *const phase_names[PHASE_COUNT] = {"input", "emulate", "sleep", "render", "timers"};
+static const char *const op_names[OP_COUNT] = {
+#define X(name) #name,
+    CHIP8_OPCODES(X)
+#undef X
+};
+
+// Write the profile as JSON if path ends in .json, otherwise as folded stacks for flamegraph.pl /
+// speedscope. Folded weights are nanoseconds; emulate time is split across opcode;PC frames in
+// proportion to how often each address executed
+static bool profile_write(const PROFILER_T *profiler, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        SDL_Log("Could not write profile %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    const double us_per_tick = 1e6 / (double)SDL_GetPerformanceFrequency();
+    uint64_t instructions = 0;
+    for (const uint64_t count : profiler->op_counts) instructions += count;
+
+    const size_t length = strlen(path);
+    if (length >= 5 && strcmp(path + length - 5, ".json") == 0) {
+        fprintf(out, "{\n  \"frames\": %llu,\n  \"instructions\": %llu,\n  \"phases_us\": {",
+                (unsigned long long)profiler->frames, (unsigned long long)instructions);
+        for (uint32_t i = 0; i < PHASE_COUNT; i++)
+            fprintf(out, "%s\"%s\": %.0f", i ? ", " : "", phase_names[i], profiler->phase_ticks[i] * us_per_tick);
+        fprintf(out, "},\n  \"opcodes\": {");
+        bool first = true;
+        for (uint32_t op = 0; op < OP_COUNT; op++) {
+            if (!profiler->op_counts[op]) continue;
+            fprintf(out, "%s\"%s\": %llu", first ? "" : ", ", op_names[op], (unsigned long long)profiler->op_counts[op]);
+            first = false;
+        }
+        fprintf(out, "},\n  \"pcs\": {");
+        first = true;
+        for (uint32_t PC = 0; PC < profiler->memory_size; PC++) {
+            if (!profiler->pc_counts[PC]) continue;
+            fprintf(out, "%s\"%03X\": %llu", first ? "" : ", ", PC, (unsigned long long)profiler->pc_counts[PC]);
+            first = false;
+        }
+        fprintf(out, "}\n}\n");
+    } else {
+        const double emulate_ns = profiler->phase_ticks[PHASE_EMULATE] * us_per_tick * 1000;
+        for (uint32_t i = 0; i < PHASE_COUNT; i++) {
+            if (i == PHASE_EMULATE && instructions) continue;
+            fprintf(out, "frame;%s %.0f\n", phase_names[i], profiler->phase_ticks[i] * us_per_tick * 1000);
+        }
+        for (uint32_t PC = 0; PC < profiler->memory_size && instructions; PC++) {
+            if (!profiler->pc_counts[PC]) continue;
+            fprintf(out, "frame;emulate;%s;%03X %.0f\n", op_names[profiler->pc_ops[PC]], PC,
+                    emulate_ns * profiler->pc_counts[PC] / instructions);
+        }
+    }
+    fclose(out);
+    return true;
+}
+#endif
+
+// Emulate chip8->cycles instructions one at a time through the interpreter for --record and --profile.
+// Every instruction is dispatched with an empty budget so superinstructions and idle-loop
+// fast-forwarding never hide one from the trace or the counts
+template <typename QUIRKS>
+void run_observed(CHIP_8 *chip8, const CONFIG_T &config) {
+    if (!chip8->recorder && !chip8->profiler) {
+        run_switch<QUIRKS>(chip8, config);
+        return;
+    }
+
+    while (chip8->cycles) {
+        const uint32_t left = chip8->cycles - 1;
+        const uint16_t PC = chip8->PC;
+        const uint16_t I = chip8->I;
+        uint8_t V[16];
+        memcpy(V, chip8->V, sizeof V);
+
+        chip8->cycles = 0;
+        emulate_instructions<QUIRKS>(chip8, config);
+        chip8->cycles = left;
+        if (chip8->recorder) record_instruction(chip8->recorder, chip8, PC, V, I);
+        if (chip8->profiler) profile_instruction(chip8->profiler, PC, chip8->inst);
+    }
+}
+
+// Pick the engine instantiation for one quirk set
+template <typename QUIRKS>
+RUN_FN_T select_engine(const CONFIG_T &config) {
+    if (config.record_path || config.profile_path) return run_observed<QUIRKS>; // Needs to see every instruction
+    switch (config.engine) {
+#ifdef CHIP8_AOT
+        case ENGINE_AOT: return run_aot<QUIRKS>;
+#endif
+#ifdef CHIP8_HAS_JIT
+        case ENGINE_JIT: return run_jit<QUIRKS>;
+#endif
+#ifdef CHIP8_HAS_COMPUTED_GOTO
+        case ENGINE_THREADED: return run_threaded<QUIRKS>;
+#endif
+        default: return run_switch<QUIRKS>;
+    }
+}
+
+// Pick the engine and quirk set once; every frame after that is a single indirect call.
+// The quirk set is the machine's own, which its memory was sized for
+RUN_FN_T select_engine(const EXTENSION_T ex, const CONFIG_T &config) {
+    switch (ex) {
+        case SUPERCHIP: return select_engine<QUIRKS_T<SUPERCHIP>>(config);
+        case XOCHIP: return select_engine<QUIRKS_T<XOCHIP>>(config);
+        case CHIP8: default: return select_engine<QUIRKS_T<CHIP8>>(config);
+    }
+}
+
+// Release the machine's memory and the engine caches, recorder and movie it picked up while running
+void destroy_chip8(CHIP_8 *chip8) {
+#ifdef CHIP8_HAS_JIT
+    jit_destroy(chip8);
+#endif
+#ifdef CHIP8_AOT
+    aot_destroy(chip8);
+#endif
+    record_close(chip8);
+    movie_close(chip8);
+    free(chip8->ram);
+    free(chip8->decode_cache);
+    chip8->ram = nullptr;
+    chip8->decode_cache = nullptr;
+}
+
+// Emulate count instructions with the configured engine
+void run_instructions(CHIP_8 *chip8, const CONFIG_T &config, const uint32_t count) {
+    if (!chip8->run) chip8->run = select_engine(chip8->extension, config);
+    if (!chip8->movie) {
+        chip8->cycles = count;
+        chip8->run(chip8, config);
+        chip8->instructions += count;
+        return; }
+
+    // A movie splits the batch at every keypad change it plays back
+    for (uint32_t left = count; left;) {
+        const uint32_t batch = movie_apply(chip8, left);
+        chip8->cycles = batch;
+        chip8->run(chip8, config);
+        chip8->instructions += batch;
+        left -= batch;
+    }
+}
+
+// Sleep until the performance counter reaches deadline. SDL_Delay covers all but a margin that is spun.
+// The margin starts at 200 us and follows the worst recent SDL_Delay overshoot (capped at 2 ms), rising
+// at once and decaying slowly, so a coarse scheduler tick is still covered without burning 2 ms a frame
+void wait_until(const uint64_t deadline) {
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    const uint64_t min_margin = freq / 5000, max_margin = freq / 500;
+    static uint64_t margin = 0;
+    if (margin < min_margin) margin = min_margin;
+    for (uint64_t now = SDL_GetPerformanceCounter(); now < deadline; now = SDL_GetPerformanceCounter()) {
+        if (deadline - now <= margin) continue;
+        const uint32_t ms = (uint32_t)((deadline - now - margin) * 1000 / freq);
+        if (!ms) continue;
+        const uint64_t target = now + (uint64_t)ms * freq / 1000;
+        SDL_Delay(ms);
+        const uint64_t woke = SDL_GetPerformanceCounter();
+        const uint64_t overshoot = woke > target ? woke - target : 0;
+        if (overshoot > margin) margin = overshoot < max_margin ? overshoot : max_margin;
+        else margin -= (margin - min_margin) / 16;
+    }
+}
+
+// Instructions between 60 Hz timer tick number tick and the next at clock_rate; every pacing mode runs
+// exactly this many, so a run's instruction stream doesn't depend on how it was paced
+static uint64_t tick_budget(const uint64_t tick, const uint32_t clock_rate) {
+    return (tick + 1) * clock_rate / 60 - tick * clock_rate / 60;
+}
+
+// Counter value of tick number ticks of a rate Hz clock that started at start. Computed from the
+// start rather than by adding periods, so rounding never accumulates into drift
+static uint64_t clock_tick(const uint64_t start, const uint64_t ticks, const uint32_t rate, const uint64_t freq) {
+    return start + ticks * freq / rate;
+}
+
+// Rewind history: one entry per 60 Hz frame, each the XOR of that frame's SAVESTATE_T with the
+// previous one, run-length encoded, with a keyframe (XOR against zero) every
+// REWIND_KEYFRAME_INTERVAL frames. Entries are packed into a byte ring; when it or the index fills,
+// the oldest keyframe and its deltas go together, so history always starts at a keyframe.
+// A typical frame changes a few dozen bytes, so minutes of play fit in a few MB
+#define REWIND_BUFFER_SIZE (4 << 20)    // Encoded frame bytes
+#define REWIND_MAX_FRAMES (60 * 60 * 5) // Five minutes of 60 Hz frames
+#define REWIND_KEYFRAME_INTERVAL 60
+#define REWIND_SPEED 2                  // Frames stepped back per 60 Hz tick while rewinding
+#define REWIND_MAX_ENCODED (2 * sizeof(SAVESTATE_T) + 8) // Worst case for one encoded frame
+
+struct REWIND_FRAME_T {
+    uint32_t offset;            // Start in REWIND_T::data
+    uint32_t size;
+    bool keyframe;
+};
+
+struct REWIND_T {
+    uint8_t data[REWIND_BUFFER_SIZE];
+    uint32_t head;              // Where the next frame is written
+    REWIND_FRAME_T frames[REWIND_MAX_FRAMES]; // Ring of count entries starting at first, oldest first
+    uint32_t first;
+    uint32_t count;
+    uint32_t since_keyframe;    // Frames pushed since the newest keyframe
+    SAVESTATE_T newest;         // State of the newest frame, the base of the next delta
+    uint8_t scratch[REWIND_MAX_ENCODED];
+};
+
+static const SAVESTATE_T zero_state = {};
+
+// XOR of a and b as runs of [skip:u32][length:u32][length bytes], ending with a zero-length run;
+// 32 bits because XO-CHIP's 64 KB of RAM alone is past what 16 bits can skip.
+// A run only ends at 4 equal bytes, so short gaps don't cost a run header each
+static uint32_t rewind_encode(const uint8_t *a, const uint8_t *b, const uint32_t size, uint8_t *out) {
+    uint32_t i = 0, n = 0;
+    for (;;) {
+        const uint32_t start = i;
+        for (uint64_t x, y; i + 8 <= size && (memcpy(&x, a + i, 8), memcpy(&y, b + i, 8), x == y); ) i += 8;
+        while (i < size && a[i] == b[i]) i++;
+        if (i == size) break;
+
+        const uint32_t literal = i;
+        uint32_t same = 0;
+        for (; i < size && same < 4; i++) same = a[i] == b[i] ? same + 1 : 0;
+        i -= same;
+        const uint32_t skip = literal - start, length = i - literal;
+        memcpy(&out[n], &skip, 4);
+        memcpy(&out[n + 4], &length, 4);
+        n += 8;
+        for (uint32_t k = literal; k < i; k++) out[n++] = a[k] ^ b[k];
+    }
+    memset(&out[n], 0, 8);
+    return n + 8;
+}
+
+static void rewind_apply(uint8_t *state, const uint8_t *delta) {
+    for (uint32_t pos = 0;;) {
+        uint32_t skip, length;
+        memcpy(&skip, delta, 4);
+        memcpy(&length, delta + 4, 4);
+        if (!length) return;
+        delta += 8;
+        pos += skip;
+        for (uint32_t k = 0; k < length; k++) state[pos + k] ^= delta[k];
+        pos += length;
+        delta += length;
+    }
+}
+
+static REWIND_FRAME_T *rewind_frame(REWIND_T *rewind, const uint32_t age) { // age 0 is the oldest
+    return &rewind->frames[(rewind->first + age) % REWIND_MAX_FRAMES];
+}
+
+// Drop the oldest keyframe and the deltas built on it
+static void rewind_evict(REWIND_T *rewind) {
+    do {
+        rewind->first = (rewind->first + 1) % REWIND_MAX_FRAMES;
+        rewind->count--;
+    } while (rewind->count && !rewind_frame(rewind, 0)->keyframe);
+}
+
+// Record the frame the machine has just finished; microseconds, even for keyframes
+void rewind_push(REWIND_T *rewind, const CHIP_8 *chip8) {
+    SAVESTATE_T state;
+    save_state(chip8, &state);
+    const bool keyframe = !rewind->count || rewind->since_keyframe + 1 >= REWIND_KEYFRAME_INTERVAL;
+    const uint32_t size = rewind_encode((const uint8_t *)&state, (const uint8_t *)(keyframe ? &zero_state : &rewind->newest),
+                                        state.size, rewind->scratch);
+
+    // Find room after head, wrapping to the start of data, evicting from the oldest end until it fits
+    for (;;) {
+        if (!rewind->count) {
+            rewind->head = 0;
+            break; }
+        const uint32_t tail = rewind_frame(rewind, 0)->offset;
+        if (rewind->count < REWIND_MAX_FRAMES) {
+            if (rewind->head > tail) { // Live bytes in [tail, head)
+                if (rewind->head + size <= REWIND_BUFFER_SIZE) break;
+                if (size <= tail) {
+                    rewind->head = 0;
+                    break; }
+            } else if (rewind->head + size <= tail) break; // Wrapped: free bytes in [head, tail)
+        }
+        rewind_evict(rewind);
+    }
+    if (!rewind->count && !keyframe) { // Evicted the keyframe this delta needed
+        rewind->since_keyframe = REWIND_KEYFRAME_INTERVAL;
+        return rewind_push(rewind, chip8);
+    }
+
+    memcpy(&rewind->data[rewind->head], rewind->scratch, size);
+    *rewind_frame(rewind, rewind->count++) = {rewind->head, size, keyframe};
+    rewind->head += size;
+    rewind->since_keyframe = keyframe ? 0 : rewind->since_keyframe + 1;
+    memcpy(&rewind->newest, &state, state.size); // The rest of a CHIP-8 state is never written
+}
+
+// Step the machine back one recorded frame; false once history has run out. The live keypad is
+// kept, since the player is still holding whatever keys they are holding
+bool rewind_pop(REWIND_T *rewind, CHIP_8 *chip8) {
+    if (rewind->count < 2) {
+        if (rewind->count) load_state(chip8, &rewind->newest); // Oldest frame there is
+        return false; }
+
+    const REWIND_FRAME_T dropped = *rewind_frame(rewind, --rewind->count);
+    rewind->head = dropped.offset;
+    if (!dropped.keyframe) {
+        rewind_apply((uint8_t *)&rewind->newest, &rewind->data[dropped.offset]);
+        rewind->since_keyframe--;
+    } else {
+        // Rebuild the new newest frame forward from its keyframe
+        uint32_t age = rewind->count - 1;
+        while (!rewind_frame(rewind, age)->keyframe) age--;
+        rewind->since_keyframe = rewind->count - 1 - age;
+        rewind->newest = zero_state;
+        for (; age < rewind->count; age++)
+            rewind_apply((uint8_t *)&rewind->newest, &rewind->data[rewind_frame(rewind, age)->offset]);
+    }
+
+    bool keypad[16];
+    memcpy(keypad, chip8->keypad, sizeof keypad);
+    load_state(chip8, &rewind->newest);
+    memcpy(chip8->keypad, keypad, sizeof keypad);
+    return true;
+}
+
+// --max-frames reached after ticks 60 Hz frames; ends a windowed run as it does a headless one
+static bool frame_limit(const CONFIG_T &config, const uint64_t ticks) {
+    return config.max_frames && ticks >= config.max_frames;
+}
+
+// Emulation thread: input in, frames out. Three clock domains run off the performance counter:
+// the CPU at config.clock_rate, the delay timer at 60 Hz and frame publishing at config.refresh_rate.
+// Each tick owes (t + 1) * clock_rate / 60 - t * clock_rate / 60 instructions, as in headless runs and
+// fast-forward; wake-ups inside a tick only decide how that budget is spread, and whatever is left runs
+// before the tick is applied, so the count between ticks never depends on the host's counter or timing.
+// Fast-forward drops the wall clock: emulated frames run back to back, timers still tick once per
+// emulated frame, and only the last frame of each display tick is published. Sound plays while the
+// sound timer runs, except when paused or rewinding
+void emulation_thread(CHIP_8 *chip8, const CONFIG_T &config, INPUT_QUEUE_T *input, FRAMEBUFFER_T *framebuffer, AUDIO_T *audio) {
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t start = SDL_GetPerformanceCounter(); // Where all three clocks count from
+    uint64_t cpu_time = start;          // Counter value the CPU has been run up to
+    uint64_t cpu_fraction = 0;          // Part of an instruction owed within this tick, in 1/freq instructions
+    uint64_t tick_count = 0;            // Instructions run since the last timer tick
+    uint64_t timer_ticks = 0;
+    uint64_t frames = 0;
+    uint64_t mark = start;
+    bool turbo = config.turbo;
+    uint64_t speed_time = start;        // Start of the current fast-forward speed measurement
+    uint64_t speed_ticks = 0;           // timer_ticks at speed_time
+    REWIND_T *rewind = (REWIND_T *)calloc(1, sizeof(REWIND_T)); // Rewind is simply off if this fails
+    bool rewinding = false;
+
+    while (chip8->state != QUIT && !frame_limit(config, timer_ticks)) {
+        INPUT_EVENT_T event;
+        while (input_pop(input, &event)) {
+            if (event.type == INPUT_TURBO) {
+                turbo = !turbo;
+                speed_time = SDL_GetPerformanceCounter();
+                speed_ticks = timer_ticks;
+                if (!turbo) framebuffer->speed.store(0, memory_order_relaxed);
+                cpu_fraction = 0; // Either way the next instructions start a fresh share of the tick
+            } else if (event.type == INPUT_REWIND) {
+                rewinding = event.key && rewind && !chip8->movie; // History would break a movie too
+            } else apply_input(chip8, config, event);
+        }
+        audio_update(audio, chip8, chip8->state == RUNNING && !rewinding && chip8->sound_timer > 0);
+
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (chip8->state != RUNNING || now - cpu_time > freq / 4) {
+            // Paused, or stalled (debugger, suspended window) for long enough that catching up would
+            // just fast-forward: move every clock past the gap instead
+            start += now - cpu_time;
+            cpu_time = now;
+            if (chip8->state != RUNNING) {
+                SDL_Delay(1);
+                continue;
+            }
+        }
+
+        if (rewinding) {
+            // History replaces the CPU: REWIND_SPEED frames back per 60 Hz tick, shown as they come
+            const uint64_t next_timer = clock_tick(start, timer_ticks + 1, 60, freq);
+            if (now >= next_timer) {
+                for (int i = 0; i < REWIND_SPEED && rewind_pop(rewind, chip8); i++) {}
+                timer_ticks = (now - start) * 60 / freq;
+                framebuffer_publish(framebuffer, chip8);
+                frames = (now - start) * config.refresh_rate / freq;
+            }
+            cpu_time = now; // The CPU picks up from here, not from where rewinding began
+            cpu_fraction = 0;
+            tick_count = 0; // History frames are whole ticks
+            wait_until(clock_tick(start, timer_ticks + 1, 60, freq));
+            continue;
+        }
+
+        if (turbo) {
+            // Whole emulated frames until the next display tick is due
+            const uint64_t present = now + freq / config.refresh_rate;
+            do {
+                run_instructions(chip8, config, (uint32_t)(tick_budget(timer_ticks, config.clock_rate) - tick_count));
+                profile_phase(chip8->profiler, PHASE_EMULATE, &mark);
+                update_timers(chip8);
+                timer_ticks++;
+                tick_count = 0;
+                if (rewind) rewind_push(rewind, chip8);
+                profile_phase(chip8->profiler, PHASE_TIMERS, &mark);
+                now = SDL_GetPerformanceCounter();
+            } while (now < present && !frame_limit(config, timer_ticks));
+
+            framebuffer_publish(framebuffer, chip8);
+            if (chip8->profiler) chip8->profiler->frames++;
+
+            // Emulated time is now, so the real-time clocks carry on from here once fast-forward ends
+            start = now - timer_ticks * freq / 60;
+            cpu_time = now;
+            frames = (now - start) * config.refresh_rate / freq;
+
+            if (now - speed_time >= freq / 2) {
+                framebuffer->speed.store((uint32_t)((timer_ticks - speed_ticks) * freq * 100 / 60 / (now - speed_time)), memory_order_relaxed);
+                speed_time = now;
+                speed_ticks = timer_ticks;
+            }
+            profile_phase(chip8->profiler, PHASE_TIMERS, &mark);
+            continue;
+        }
+
+        // Run the CPU up to now, stopping at each timer tick on the way to apply it
+        for (;;) {
+            const uint64_t next_timer = clock_tick(start, timer_ticks + 1, 60, freq);
+            const uint64_t target = next_timer < now ? next_timer : now;
+            const uint64_t left = tick_budget(timer_ticks, config.clock_rate) - tick_count;
+            uint64_t count = left; // The rest of the tick's budget once the tick is reached
+            if (target != next_timer) {
+                cpu_fraction += (target - cpu_time) * config.clock_rate;
+                count = cpu_fraction / freq < left ? cpu_fraction / freq : left;
+                cpu_fraction %= freq;
+            }
+            cpu_time = target;
+            if (count) run_instructions(chip8, config, (uint32_t)count);
+            tick_count += count;
+            profile_phase(chip8->profiler, PHASE_EMULATE, &mark);
+
+            if (target != next_timer) break;
+            update_timers(chip8);
+            timer_ticks++;
+            tick_count = 0;
+            cpu_fraction = 0;
+            if (rewind) rewind_push(rewind, chip8);
+            profile_phase(chip8->profiler, PHASE_TIMERS, &mark);
+            if (frame_limit(config, timer_ticks)) break;
+        }
+
+        // Publish at most one frame per display tick; ticks missed while behind are dropped
+        const uint64_t next_frame = clock_tick(start, frames + 1, config.refresh_rate, freq);
+        if (now >= next_frame) {
+            framebuffer_publish(framebuffer, chip8);
+            frames = (now - start) * config.refresh_rate / freq;
+            if (chip8->profiler) chip8->profiler->frames++;
+            profile_phase(chip8->profiler, PHASE_TIMERS, &mark);
+        }
+
+        const uint64_t timer_deadline = clock_tick(start, timer_ticks + 1, 60, freq);
+        const uint64_t frame_deadline = clock_tick(start, frames + 1, config.refresh_rate, freq);
+        wait_until(timer_deadline < frame_deadline ? timer_deadline : frame_deadline);
+        profile_phase(chip8->profiler, PHASE_SLEEP, &mark);
+    }
+    free(rewind);
+    framebuffer->stopped.store(true, memory_order_release);
+}
+
+// 64-bit FNV-1a of the words of the current resolution, row by row, little-endian; what --until-hash
+// compares against. Lo-res hashes only the first word of the first 32 rows. XO-CHIP planes after the
+// first follow in order, each only if it has a pixel lit, so plane 0 alone hashes as CHIP-8 always has
+uint64_t display_hash(const CHIP_8 *chip8) {
+    const uint32_t words = chip8->hires ? DISPLAY_WORDS : 1, height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    uint64_t hash = 0xCBF29CE484222325;
+    for (uint32_t p = 0; p < display_planes(chip8->extension); p++) {
+        uint64_t lit = p == 0;
+        for (uint32_t y = 0; y < height && !lit; y++)
+            for (uint32_t w = 0; w < words; w++) lit |= chip8->display[p][y][w];
+        if (!lit) continue;
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t *bytes = (const uint8_t *)chip8->display[p][y];
+            for (size_t i = 0; i < words * sizeof chip8->display[p][y][0]; i++) {
+                hash ^= bytes[i];
+                hash *= 0x100000001B3;
+            }
+        }
+    } return hash;
+}
+
+static_assert(sizeof(SAVESTATE_T) == 69768, "save state layout is part of the file format");
+static_assert(offsetof(SAVESTATE_T, xo_ram) == 5256, "save state layout is part of the file format");
+static_assert(std::endian::native == std::endian::little, "save states are stored little-endian");
+
+// --quirks name of an EXTENSION_T stored in a save state or movie header
+static const char *extension_name(const uint8_t extension) {
+    return extension == XOCHIP ? "xochip" : extension == SUPERCHIP ? "superchip" : "chip8";
+}
+
+static uint64_t state_checksum(const SAVESTATE_T *state) {
+    const uint8_t *bytes = (const uint8_t *)state + offsetof(SAVESTATE_T, checksum) + sizeof state->checksum;
+    const uint8_t *const end = (const uint8_t *)state + state->size;
+    uint64_t hash = 0xCBF29CE484222325;
+    for (; bytes < end; bytes++) {
+        hash ^= *bytes;
+        hash *= 0x100000001B3;
+    } return hash;
+}
+
+// Snapshot into state; some 5 KB of copies, 70 KB under XO-CHIP, nothing allocated
+void save_state(const CHIP_8 *chip8, SAVESTATE_T *state) {
+    state->magic = SAVESTATE_MAGIC;
+    state->version = SAVESTATE_VERSION;
+    state->extension = (uint8_t)chip8->extension;
+    state->reserved = 0;
+    state->size = savestate_size(chip8->extension);
+    state->checksum = 0;
+    memcpy(state->ram, chip8->ram, sizeof state->ram);
+    memcpy(state->display, chip8->display[0], sizeof state->display);
+    memcpy(state->stack, chip8->stack, sizeof state->stack);
+    state->I = chip8->I;
+    state->PC = chip8->PC;
+    state->rng = chip8->rng;
+    memcpy(state->V, chip8->V, sizeof state->V);
+    memcpy(state->keypad, chip8->keypad, sizeof state->keypad);
+    memcpy(state->rpl, chip8->rpl, sizeof state->rpl);
+    memcpy(state->audio_pattern, chip8->audio_pattern, sizeof state->audio_pattern);
+    state->stack_depth = (uint8_t)(chip8->stack_ptr - chip8->stack);
+    state->delay_timer = chip8->delay_timer;
+    state->sound_timer = chip8->sound_timer;
+    state->anykey_pressed = chip8->anykey_pressed;
+    state->key = chip8->key;
+    state->hires = chip8->hires;
+    state->planes = chip8->planes;
+    state->pitch = chip8->pitch;
+    memset(state->padding, 0, sizeof state->padding);
+    if (chip8->extension == XOCHIP) {
+        memcpy(state->xo_ram, &chip8->ram[sizeof state->ram], sizeof state->xo_ram);
+        memcpy(state->xo_display, chip8->display[1], sizeof state->xo_display);
+    }
+}
+
+// Copy size bytes of saved memory to address, dropping only the span that differs from the caches
+static void load_ram(CHIP_8 *chip8, const uint32_t address, const uint8_t *saved, const uint32_t size) {
+    uint8_t *const ram = &chip8->ram[address];
+    if (memcmp(ram, saved, size) == 0) return;
+    uint32_t first = 0, last = size;
+    while (ram[first] == saved[first]) first++;
+    while (ram[last - 1] == saved[last - 1]) last--;
+    memcpy(&ram[first], &saved[first], last - first);
+    invalidate_decode_cache(chip8, address + first, last - first);
+}
+
+// Restore a snapshot. Only the span of RAM that differs is dropped from the decode, JIT and AOT
+// caches, so resetting to a state of the same ROM stays cheap
+bool load_state(CHIP_8 *chip8, const SAVESTATE_T *state) {
+    if (state->magic != SAVESTATE_MAGIC || state->version != SAVESTATE_VERSION) {
+        SDL_Log("Not a version %d save state", SAVESTATE_VERSION);
+        return false; }
+    if (state->extension != chip8->extension) {
+        SDL_Log("Save state was made with --quirks %s", extension_name(state->extension));
+        return false; }
+    if (state->size != savestate_size(chip8->extension)) {
+        SDL_Log("Save state is %u bytes, %u for this machine's memory", state->size, savestate_size(chip8->extension));
+        return false; }
+    if (state->stack_depth > STACK_DEPTH || state->key > 0xF || state->planes > 0xF || state->rng == 0) {
+        SDL_Log("Save state is corrupt");
+        return false; }
+
+    load_ram(chip8, 0, state->ram, sizeof state->ram);
+    memcpy(chip8->display[0], state->display, sizeof state->display);
+    if (chip8->extension == XOCHIP) {
+        load_ram(chip8, sizeof state->ram, state->xo_ram, sizeof state->xo_ram);
+        memcpy(chip8->display[1], state->xo_display, sizeof state->xo_display);
+    }
+    chip8->hires = state->hires != 0;
+    chip8->damage = DAMAGE_ALL;
+    memcpy(chip8->stack, state->stack, sizeof chip8->stack);
+    chip8->stack_ptr = &chip8->stack[state->stack_depth];
+    chip8->I = state->I;
+    chip8->PC = state->PC;
+    chip8->rng = state->rng;
+    memcpy(chip8->V, state->V, sizeof chip8->V);
+    memcpy(chip8->keypad, state->keypad, sizeof chip8->keypad);
+    memcpy(chip8->rpl, state->rpl, sizeof chip8->rpl);
+    memcpy(chip8->audio_pattern, state->audio_pattern, sizeof chip8->audio_pattern);
+    chip8->planes = state->planes;
+    chip8->pitch = state->pitch;
+    chip8->delay_timer = state->delay_timer;
+    chip8->sound_timer = state->sound_timer;
+    chip8->anykey_pressed = state->anykey_pressed != 0;
+    chip8->key = state->key;
+    return true;
+}
+
+bool write_state_file(const char *path, const CHIP_8 *chip8) {
+    SAVESTATE_T state;
+    save_state(chip8, &state);
+    state.checksum = state_checksum(&state);
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        SDL_Log("Could not open save state %s: %s", path, strerror(errno));
+        return false; }
+    const bool written = fwrite(&state, state.size, 1, out) == 1;
+    if (fclose(out) != 0 || !written) {
+        SDL_Log("Could not write save state %s", path);
+        return false;
+    } return true;
+}
+
+bool read_state_file(const char *path, CHIP_8 *chip8) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        SDL_Log("Could not open save state %s: %s", path, strerror(errno));
+        return false; }
+    SAVESTATE_T state;
+    const uint32_t head = savestate_size(CHIP8); // Every state has this much; XO-CHIP's tail follows
+    bool complete = fread(&state, head, 1, in) == 1;
+    if (complete && state.magic == SAVESTATE_MAGIC && state.size == sizeof state)
+        complete = fread((uint8_t *)&state + head, sizeof state - head, 1, in) == 1;
+    fclose(in);
+    if (!complete || state.magic != SAVESTATE_MAGIC) {
+        SDL_Log("%s is not a CHIP-8 save state", path);
+        return false; }
+    if (state.version == SAVESTATE_VERSION && state.extension != chip8->extension) {
+        SDL_Log("Save state %s was made with --quirks %s", path, extension_name(state.extension));
+        return false; }
+    if (state.version == SAVESTATE_VERSION &&
+        ((state.size != head && state.size != sizeof state) || state.checksum != state_checksum(&state))) {
+        SDL_Log("Save state %s is corrupt (checksum mismatch)", path);
+        return false; }
+    for (uint32_t i = 0; i < sizeof state.keypad; i++) {
+        if (state.keypad[i] > 1) {
+            SDL_Log("Save state %s is corrupt", path);
+            return false; }
+    } return load_state(chip8, &state);
+}
+
+static_assert(sizeof(MOVIE_HEADER_T) == 24, "movie header layout is part of the file format");
+
+struct MOVIE_EVENT_T {
+    uint64_t instruction;       // Instructions since the movie started
+    uint8_t key;
+    bool down;
+};
+
+struct MOVIE_T {
+    FILE *out;                  // Recording; nullptr while playing
+    uint64_t base;              // chip8->instructions when the movie started
+    uint64_t last;              // Recording: stamp of the previous keypad change
+    MOVIE_EVENT_T *events;      // Playing: every keypad change, in order
+    uint32_t *frames;           // Playing: display checksum per frame
+    size_t event_count, frame_count;
+    size_t next_event, next_frame;
+    bool desynced, finished;
+};
+
+static uint64_t movie_state_hash(const CHIP_8 *chip8) {
+    SAVESTATE_T state;
+    save_state(chip8, &state);
+    return state_checksum(&state);
+}
+
+// Start recording to path from the machine as it is now
+MOVIE_T *movie_record(const char *path, const CHIP_8 *chip8, const CONFIG_T &config) {
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        SDL_Log("Could not open movie %s: %s", path, strerror(errno));
+        return nullptr; }
+
+    const MOVIE_HEADER_T header = {
+            .magic = MOVIE_MAGIC,
+            .version = MOVIE_VERSION,
+            .extension = (uint8_t)config.current_ex,
+            .reserved = 0,
+            .seed = chip8->rng,
+            .clock_rate = config.clock_rate,
+            .state_hash = movie_state_hash(chip8),
+    };
+    MOVIE_T *movie = (MOVIE_T *)calloc(1, sizeof(MOVIE_T));
+    if (!movie || fwrite(&header, sizeof header, 1, out) != 1) {
+        SDL_Log("Could not write movie %s", path);
+        fclose(out);
+        free(movie);
+        return nullptr; }
+    movie->out = out;
+    movie->base = chip8->instructions;
+    return movie;
+}
+
+// Load path for playback. The recorded seed and clock rate replace the machine's and config's; the
+// quirk set must match config's, which has already sized the window, and the machine must otherwise
+// be in the state recording started from
+MOVIE_T *movie_play(const char *path, CHIP_8 *chip8, CONFIG_T *config) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        SDL_Log("Could not open movie %s: %s", path, strerror(errno));
+        return nullptr; }
+    uint8_t *data = nullptr;
+    long size = -1;
+    if (fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0 && fseek(in, 0, SEEK_SET) == 0 &&
+        (data = (uint8_t *)malloc((size_t)size + 1)) && fread(data, 1, (size_t)size, in) != (size_t)size) size = -1;
+    fclose(in);
+
+    MOVIE_HEADER_T header;
+    if (size < (long)sizeof header || !data) {
+        SDL_Log("%s is not a CHIP-8 movie", path);
+        free(data);
+        return nullptr; }
+    memcpy(&header, data, sizeof header);
+    if (header.magic != MOVIE_MAGIC || header.version != MOVIE_VERSION || header.extension > XOCHIP ||
+        header.seed == 0 || header.clock_rate == 0) {
+        SDL_Log("%s is not a version %d CHIP-8 movie", path, MOVIE_VERSION);
+        free(data);
+        return nullptr; }
+    if (header.extension != config->current_ex) {
+        SDL_Log("Movie %s was recorded with --quirks %s", path, extension_name(header.extension));
+        free(data);
+        return nullptr; }
+
+    // Count first, then fill: tags are one byte, followed by a LEB128 delta or a 4-byte checksum
+    MOVIE_T *movie = (MOVIE_T *)calloc(1, sizeof(MOVIE_T));
+    bool valid = movie != nullptr;
+    for (int pass = 0; pass < 2 && valid; pass++) {
+        uint64_t stamp = 0;
+        size_t events = 0, frames = 0;
+        for (size_t at = sizeof header; at < (size_t)size && valid;) {
+            const uint8_t tag = data[at++];
+            if (tag == MOVIE_FRAME) {
+                if (at + 4 > (size_t)size) valid = false;
+                else if (pass) memcpy(&movie->frames[frames], &data[at], 4);
+                frames++;
+                at += 4;
+            } else if (tag < MOVIE_KEY + 0x20) {
+                uint64_t delta = 0;
+                for (uint32_t shift = 0;; shift += 7) {
+                    if (at == (size_t)size || shift > 63) {
+                        valid = false;
+                        break; }
+                    delta |= (uint64_t)(data[at] & 0x7F) << shift;
+                    if (!(data[at++] & 0x80)) break;
+                }
+                stamp += delta;
+                if (pass) movie->events[events] = {stamp, (uint8_t)(tag & 0xF), (tag & 0x10) != 0};
+                events++;
+            } else valid = false;
+        }
+        if (!pass && valid) {
+            movie->event_count = events;
+            movie->frame_count = frames;
+            movie->events = (MOVIE_EVENT_T *)malloc((events + 1) * sizeof(MOVIE_EVENT_T));
+            movie->frames = (uint32_t *)malloc((frames + 1) * sizeof(uint32_t));
+            valid = movie->events && movie->frames;
+        }
+    }
+    free(data);
+    if (!valid) {
+        SDL_Log("Movie %s is corrupt", path);
+        if (movie) { free(movie->events); free(movie->frames); }
+        free(movie);
+        return nullptr; }
+
+    chip8->rng = header.seed;
+    if (movie_state_hash(chip8) != header.state_hash) {
+        SDL_Log("Movie %s was recorded from a different ROM or start state", path);
+        free(movie->events);
+        free(movie->frames);
+        free(movie);
+        return nullptr; }
+    config->clock_rate = header.clock_rate;
+    movie->base = chip8->instructions;
+    return movie;
+}
+
+static void movie_write_stamp(MOVIE_T *movie, uint64_t delta) {
+    do {
+        fputc((delta > 0x7F ? 0x80 : 0) | (delta & 0x7F), movie->out);
+        delta >>= 7;
+    } while (delta);
+}
+
+// A live keypad change: recorded when recording. Returns false while a movie is playing, which owns
+// the keypad until it runs out
+bool movie_key(CHIP_8 *chip8, const uint8_t key, const bool down) {
+    MOVIE_T *movie = chip8->movie;
+    if (!movie) return true;
+    if (!movie->out) return movie->finished;
+    if (chip8->keypad[key] == down) return true; // Key repeat, nothing changed
+
+    const uint64_t stamp = chip8->instructions - movie->base;
+    fputc(MOVIE_KEY | down << 4 | key, movie->out);
+    movie_write_stamp(movie, stamp - movie->last);
+    movie->last = stamp;
+    return true;
+}
+
+// Per 60 Hz frame, from update_timers: write the display checksum, or check it against the recording
+void movie_frame(CHIP_8 *chip8) {
+    MOVIE_T *movie = chip8->movie;
+    const uint32_t hash = (uint32_t)display_hash(chip8);
+    if (movie->out) {
+        const uint8_t bytes[5] = {MOVIE_FRAME, (uint8_t)hash, (uint8_t)(hash >> 8), (uint8_t)(hash >> 16), (uint8_t)(hash >> 24)};
+        fwrite(bytes, sizeof bytes, 1, movie->out);
+        return; }
+    if (movie->finished) return;
+
+    if (!movie->desynced && movie->frames[movie->next_frame] != hash) {
+        movie->desynced = true;
+        SDL_Log("Movie desynced at frame %zu (display %08X, recorded %08X)", movie->next_frame, hash, movie->frames[movie->next_frame]);
+    }
+    if (++movie->next_frame == movie->frame_count) {
+        movie->finished = true;
+        SDL_Log("Movie finished after %zu frames%s", movie->frame_count, movie->desynced ? ", desynced" : "");
+    }
+}
+
+// Playing: apply the keypad changes due now and return how many of count instructions can run before
+// the next one is due
+uint32_t movie_apply(CHIP_8 *chip8, const uint32_t count) {
+    MOVIE_T *movie = chip8->movie;
+    if (movie->out || movie->finished) return count;
+    const uint64_t now = chip8->instructions - movie->base;
+    for (; movie->next_event < movie->event_count && movie->events[movie->next_event].instruction <= now; movie->next_event++)
+        chip8->keypad[movie->events[movie->next_event].key] = movie->events[movie->next_event].down;
+    if (movie->next_event == movie->event_count) return count;
+    const uint64_t due = movie->events[movie->next_event].instruction - now;
+    return due < count ? (uint32_t)due : count;
+}
+
+bool movie_finished(const CHIP_8 *chip8) { return chip8->movie && chip8->movie->finished; }
+
+bool movie_desynced(const CHIP_8 *chip8) { return chip8->movie && chip8->movie->desynced; }
+
+// Flush a recording and release the movie
+void movie_close(CHIP_8 *chip8) {
+    MOVIE_T *movie = chip8->movie;
+    if (!movie) return;
+    if (movie->out && fclose(movie->out) != 0) SDL_Log("Could not write movie: %s", strerror(errno));
+    free(movie->events);
+    free(movie->frames);
+    free(movie);
+    chip8->movie = nullptr;
+}
+
+// Registers, stack, display hash and a hex dump of the memory the quirk set addresses
+void dump_state(FILE *out, const CHIP_8 *chip8, const char *reason, const uint64_t instructions, const uint64_t frames) {
+    fprintf(out, "exit: %s\ninstructions: %llu\nframes: %llu\n", reason, (unsigned long long)instructions, (unsigned long long)frames);
+    fprintf(out, "PC: %03X\nI: %03X\nDT: %u\nST: %u\nV:", chip8->PC, chip8->I, chip8->delay_timer, chip8->sound_timer);
+    for (int i = 0; i < 16; i++) fprintf(out, " %02X", chip8->V[i]);
+    fprintf(out, "\nstack:");
+    for (const uint16_t *entry = chip8->stack; entry < chip8->stack_ptr; entry++) fprintf(out, " %03X", *entry);
+    fprintf(out, "\ndisplay: %016llX\nram:\n", (unsigned long long)display_hash(chip8));
+    for (size_t row = 0; row < memory_size(chip8->extension); row += 16) {
+        fprintf(out, "%03zX:", row);
+        for (size_t i = row; i < row + 16; i++) fprintf(out, " %02X", chip8->ram[i]);
+        fprintf(out, "\n");
+    }
+}
+
+// Display at its current resolution as a plain PBM (P1) image, 1 for a pixel lit in any bitplane
+bool write_pbm(const char *path, const CHIP_8 *chip8) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        SDL_Log("Could not open %s for writing: %s", path, strerror(errno));
+        return false; }
+    const int width = chip8->hires ? DISPLAY_WIDTH : LORES_WIDTH, height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    fprintf(out, "P1\n%d %d\n", width, height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            bool lit = false;
+            for (uint32_t p = 0; p < display_planes(chip8->extension); p++) lit |= display_pixel(chip8->display[p], x, y);
+            fprintf(out, x == width - 1 ? "%d\n" : "%d ", lit);
+        }
+    fclose(out);
+    return true;
+}
+
+// Run without a window or pacing until an exit condition from config is met, then write the dumps
+// and save state. Frames are emulated back to back: clock_rate / 60 instructions, then a timer tick.
+// Returns false if a target (--until-pc or --until-hash) was given but a limit ended the run first,
+// or a movie desynced
+bool run_headless(CHIP_8 *chip8, const CONFIG_T &config) {
+    const bool step = config.until_pc >= 0; // PC breakpoints are checked before every instruction
+    const char *reason = nullptr;
+    uint64_t instructions = 0, frames = 0;
+    uint64_t mark = SDL_GetPerformanceCounter();
+
+    while (!reason) {
+        if (config.max_frames && frames >= config.max_frames) {
+            reason = "max-frames";
+            break; }
+
+        uint64_t count = tick_budget(frames, config.clock_rate);
+        if (config.max_instructions && count > config.max_instructions - instructions) count = config.max_instructions - instructions;
+        if (step) {
+            for (uint64_t i = 0; i < count; i++, instructions++) {
+                if (chip8->PC == config.until_pc) {
+                    reason = "until-pc";
+                    break; }
+                run_instructions(chip8, config, 1);
+            }
+        } else {
+            run_instructions(chip8, config, (uint32_t)count);
+            instructions += count;
+        }
+        profile_phase(chip8->profiler, PHASE_EMULATE, &mark);
+        if (reason) break;
+        if (config.max_instructions && instructions >= config.max_instructions) {
+            reason = "max-instructions";
+            break; }
+
+        update_timers(chip8);
+        frames++;
+        if (chip8->profiler) chip8->profiler->frames++;
+        if (config.has_until_hash && display_hash(chip8) == config.until_hash) reason = "until-hash";
+        else if (movie_finished(chip8)) reason = "movie-end";
+        profile_phase(chip8->profiler, PHASE_TIMERS, &mark);
+    }
+
+    FILE *out = config.dump_path && strcmp(config.dump_path, "-") != 0 ? fopen(config.dump_path, "w") : stdout;
+    if (!out) SDL_Log("Could not open %s for writing: %s", config.dump_path, strerror(errno));
+    else {
+        dump_state(out, chip8, reason, instructions, frames);
+        if (out != stdout) fclose(out);
+    }
+    const bool written = out && (!config.pbm_path || write_pbm(config.pbm_path, chip8)) &&
+                         (!config.save_state_path || write_state_file(config.save_state_path, chip8));
+
+    const bool targeted = config.until_pc >= 0 || config.has_until_hash;
+    return written && (!targeted || strncmp(reason, "until", strlen("until")) == 0) && !movie_desynced(chip8);
+}
+
+// Windowed run: the emulation thread paces the machine while this thread handles events and presents
+void run_window(const SDL_T &sdl, CHIP_8 *chip8, const CONFIG_T &config) {
+    clear_screen(config, sdl); // Initial screen clear
+
+    static INPUT_QUEUE_T input = {};
+    static FRAMEBUFFER_T framebuffer = {};
+    framebuffer_init(&framebuffer, display_planes(config.current_ex));
+    thread emulation(emulation_thread, chip8, cref(config), &input, &framebuffer, sdl.audio);
+
+    // Window loop: events out, frames in. Presenting never holds up the emulation thread
+    uint64_t mark = SDL_GetPerformanceCounter();
+    uint32_t shown_speed = 0;
+    bool exposed = false;
+    while (!framebuffer.stopped.load(memory_order_acquire) && handle_input(&input, &exposed)) { // Handle user input
+        const uint32_t speed = framebuffer.speed.load(memory_order_relaxed);
+        if (speed != shown_speed) update_title(sdl, shown_speed = speed);
+        profile_phase(chip8->profiler, PHASE_INPUT, &mark);
+
+        uint64_t damage;
+        framebuffer_acquire(&framebuffer, &damage);
+        if (!damage && !exposed) {
+            SDL_Delay(1); // Nothing new to draw yet: no upload, no present
+            continue;
+        }
+        update_screen(sdl, config, framebuffer.display[framebuffer.front], framebuffer.planes, framebuffer.hires[framebuffer.front], damage);
+        exposed = false;
+        profile_phase(chip8->profiler, PHASE_RENDER, &mark);
+    }
+    emulation.join();
+}
+
+#ifndef CHIP8_NO_MAIN
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    // Default Usage message for args
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <rom_name>\n", argv[0]);
+        exit(EXIT_FAILURE); }
+    
+    CONFIG_T config = {0}; // Initialize emulator options
+    if (!set_config_from_args(&config, argc, (const char **) argv)) exit(EXIT_FAILURE);
+    
+    SDL_T sdl = {nullptr}; // Initialize SDL; nothing to initialize headless
+    if (!config.headless && !INIT(&sdl, config)) exit(EXIT_FAILURE);
+    
+    CHIP_8 chip8 = {};
+    const char *rom_name = argv[1];
+    if (!init_chip8(&chip8, rom_name, config.current_ex)) exit(EXIT_FAILURE); // Initialize CHIP-8 machine
+    chip8.rng = config.seed; // CXNN generator; a loaded state brings its own
+    if (config.load_state_path && !read_state_file(config.load_state_path, &chip8)) exit(EXIT_FAILURE);
+    if (config.movie_record_path && !(chip8.movie = movie_record(config.movie_record_path, &chip8, config)))
+        exit(EXIT_FAILURE);
+    if (config.movie_play_path && !(chip8.movie = movie_play(config.movie_play_path, &chip8, &config)))
+        exit(EXIT_FAILURE);
+
+    if (config.record_path && !(chip8.recorder = record_open(config.record_path, config.record_capacity)))
+        exit(EXIT_FAILURE);
+    if (config.profile_path && !(chip8.profiler = profile_create(memory_size(chip8.extension))))
+        exit(EXIT_FAILURE);
+    trace_start(); // No-op unless built with CHIP8_TRACE_LEVEL
+    
+    bool passed = true;
+    if (config.headless) passed = run_headless(&chip8, config);
+    else {
+        run_window(sdl, &chip8, config);
+        passed = !movie_desynced(&chip8);
+    }
+    
+    destroy_chip8(&chip8);
+    if (chip8.profiler) {
+        profile_write(chip8.profiler, config.profile_path);
+        profile_destroy(chip8.profiler);
+    }
+    trace_stop();
+    if (!config.headless) final_cleanup(sdl);
+    exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
 }
+#endif
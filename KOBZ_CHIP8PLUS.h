@@ -0,0 +1,611 @@
+#ifndef KOBZ_CHIP8PLUS_H
+#define KOBZ_CHIP8PLUS_H
+
+// CHIP-8 machine state and core entry points, shared by the emulator, chip8-aot and the code it generates
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_HAS_COMPUTED_GOTO 1 // Labels-as-values available for the threaded engine
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_HAS_JIT 1 // Native x86-64 backend available
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_HAS_LOCKSTEP_AVX 1 // Lockstep kernels compiled again for AVX2/AVX-512 (auto-vectorised), picked at runtime
+#endif
+
+// Trace levels. CHIP8_TRACE_LEVEL is fixed at build time; TRACE_* calls above it compile to nothing,
+// arguments included, so release builds pay nothing for the per-opcode tracing in the handlers
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_INFO 1      // Unusual events, e.g. invalid opcodes
+#define TRACE_LEVEL_DEBUG 2     // Every executed opcode
+
+#ifndef CHIP8_TRACE_LEVEL
+#define CHIP8_TRACE_LEVEL TRACE_LEVEL_OFF
+#endif
+
+#if CHIP8_TRACE_LEVEL > TRACE_LEVEL_OFF
+#define TRACE_MAX_ARGS 4
+
+// Binary trace event; formatting is deferred to the writer thread. fmt must be a string literal
+// taking only integer arguments
+struct TRACE_RECORD_T {
+    const char *fmt;
+    uint32_t args[TRACE_MAX_ARGS];
+};
+
+void trace_push(const char *fmt, const uint32_t *args, size_t count);
+
+template <typename... ARGS>
+inline void trace_log(const char *fmt, ARGS... args) {
+    static_assert(sizeof...(args) <= TRACE_MAX_ARGS, "too many trace arguments");
+    const uint32_t values[TRACE_MAX_ARGS + 1] = {(uint32_t)args...};
+    trace_push(fmt, values, sizeof...(args));
+}
+
+void trace_start(void);
+void trace_stop(void);
+#else
+inline void trace_start(void) {}
+inline void trace_stop(void) {}
+#endif
+
+#if CHIP8_TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(...) trace_log(__VA_ARGS__)
+#else
+#define TRACE_INFO(...) ((void)0)
+#endif
+
+#if CHIP8_TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(...) trace_log(__VA_ARGS__)
+#else
+#define TRACE_DEBUG(...) ((void)0)
+#endif
+
+enum EXTENSION_T {
+    CHIP8,
+    SUPERCHIP,  // SUPER-CHIP 1.1: 128x64 hi-res, scrolling, 16x16 sprites, big font, RPL flags
+    XOCHIP,     // XO-CHIP: SUPER-CHIP plus 64 KB of memory, four bitplanes and an audio pattern buffer
+};
+
+enum ENGINE_T {
+    ENGINE_SWITCH,      // Portable dispatch through the decode cache's handler pointers
+    ENGINE_THREADED,    // Direct-threaded dispatch, each handler jumps straight to the next (GCC/Clang only)
+    ENGINE_JIT,         // Basic blocks translated to native x86-64 code (x86-64 hosts only)
+    ENGINE_AOT,         // Blocks precompiled from the ROM by chip8-aot (CHIP8_AOT builds only)
+};
+
+struct CONFIG_T {
+    uint32_t window_width;      // Width of the SDL window
+    uint32_t window_height;     // Height of the SDL window
+    uint32_t fg_color;          // Foreground color in RGBA8888 format
+    uint32_t bg_color;          // Background color in RGBA8888 format
+    uint32_t palette[16];       // XO-CHIP colors by plane bits, bit p set where plane p is lit; 0 and 1 are bg_color and fg_color
+    uint32_t scale_factor;      // Scaling factor for CHIP-8 pixel size
+    uint32_t clock_rate;        // CHIP-8 CPU Clock Rate (in Layman's Terms, number of mHz or speed)
+    uint32_t refresh_rate;      // Frames published to the window per second
+    bool turbo;                 // Start in fast-forward
+    EXTENSION_T current_ex;
+    ENGINE_T engine;            // Instruction dispatch engine
+    const char *profile_path;   // Profile report written on exit, nullptr when not profiling
+    const char *record_path;    // Execution trace file, nullptr when not recording
+    uint32_t record_capacity;   // Instructions kept in the trace ring
+    bool headless;              // No window: run to an exit condition and dump the final state
+    uint64_t max_instructions;  // Headless exit after this many instructions, 0 for no limit
+    uint64_t max_frames;        // Exit after this many 60 Hz frames, headless or windowed, 0 for no limit
+    int32_t until_pc;           // Headless exit when PC reaches this address, -1 for none
+    bool has_until_hash;
+    uint64_t until_hash;        // Headless exit when the display hashes to this (see display_hash)
+    const char *dump_path;      // Headless state dump, nullptr or "-" for stdout
+    const char *pbm_path;       // Headless final display as a PBM image, nullptr for none
+    const char *state_path;     // Save state file for F5/F9, nullptr for <rom>.state
+    const char *load_state_path; // Save state restored before the ROM starts, nullptr for none
+    const char *save_state_path; // Headless: save state written at the end of the run, nullptr for none
+    const char *movie_record_path; // Keypad movie written while running, nullptr for none
+    const char *movie_play_path; // Keypad movie replayed instead of live keys, nullptr for none
+    uint32_t seed;              // CXNN xorshift state at the first instruction, never 0
+};
+
+enum EMULATOR_STATE_T {
+    QUIT,       // State indicating the program should quit
+    RUNNING,    // State indicating the emulator is running
+    PAUSED,     // State indicating the emulator is paused
+};
+
+struct INSTRUCTION_T {
+    uint16_t opcode;
+    uint16_t NNN;    // 12-bit address
+    uint8_t NN;     // 8-bit address
+    uint8_t N;     // 4-bit address
+    uint8_t X;    // 4-bit register identifier
+    uint8_t Y;   // 4-bit register identifier
+};
+
+// Every opcode handler in decode order; expands into OPCODE_T, the handler table and the threaded engine's labels
+#define CHIP8_OPCODES(X) \
+    X(00E0) X(00EE) X(00CN) X(00DN) X(00FB) X(00FC) X(00FD) X(00FE) X(00FF) X(1NNN) X(2NNN) X(3XNN) X(4XNN) \
+    X(5XY0) X(5XY2) X(5XY3) X(6XNN) X(7XNN) X(8XY0) X(8XY1) X(8XY2) X(8XY3) X(8XY4) X(8XY5) X(8XY6) X(8XY7) X(8XYE) \
+    X(9XY0) X(ANNN) X(BNNN) X(CXNN) X(DXYN) X(EX9E) X(EXA1) X(F000) X(FN01) X(F002) \
+    X(FX07) X(FX0A) X(FX15) X(FX18) X(FX1E) X(FX29) X(FX30) X(FX33) X(FX3A) X(FX55) X(FX65) X(FX75) X(FX85) X(invalid)
+
+// Superinstructions: adjacent opcode pairs the decode cache fuses into one dispatch.
+// Picked from pair frequencies of the bundled ROMs (Pong, Tetris, Space Invaders, Brix, ...)
+#define CHIP8_FUSED_OPCODES(X) \
+    X(6XNN, 6XNN) X(6XNN, 8XY2) X(6XNN, EXA1) X(7XNN, 7XNN) X(7XNN, 3XNN) X(7XNN, 4XNN) \
+    X(7XNN, DXYN) X(ANNN, DXYN) X(ANNN, FX1E) X(FX07, 3XNN) X(3XNN, 1NNN) X(4XNN, 1NNN) \
+    X(4XNN, 4XNN) X(EXA1, 7XNN) X(EXA1, EXA1) X(EXA1, EX9E) X(EX9E, 1NNN) X(8XY2, DXYN) \
+    X(DXYN, 7XNN) X(DXYN, 00EE)
+
+enum OPCODE_T : uint8_t {
+#define X(name) OP_##name,
+    CHIP8_OPCODES(X)
+#undef X
+    OP_COUNT,                           // Opcodes decode_opcode() returns
+    OP_FUSED_BASE = OP_COUNT - 1,
+#define X(first, second) OP_##first##_##second,
+    CHIP8_FUSED_OPCODES(X)
+#undef X
+    OP_DISPATCH_COUNT,                  // Plus the superinstructions only the decode cache produces
+};
+
+// Compile-time quirk set per EXTENSION_T; engines are instantiated once per set so the
+// hot handlers carry no runtime checks on config.current_ex. SUPER-CHIP and XO-CHIP opcodes decode
+// under every set and are ignored, like invalid opcodes, where superchip or xochip is false
+template <EXTENSION_T EX> struct QUIRKS_T;
+
+#define RAM_SIZE 0x10000        // XO-CHIP's memory, the most any set addresses; QUIRKS_T::memory_size is a set's own
+#define DISPLAY_PLANES 4        // XO-CHIP bitplanes, the most any set draws; FN01 selects any combination
+
+template <> struct QUIRKS_T<CHIP8> {
+    static constexpr bool vf_reset = true;                  // 8XY1/8XY2/8XY3 clear VF
+    static constexpr bool shift_uses_vy = true;             // 8XY6/8XYE shift VY into VX rather than VX in place
+    static constexpr bool load_store_increments_i = true;   // FX55/FX65 leave I past the last register
+    static constexpr bool clip_sprites = true;              // DXYN clips at the screen edges instead of wrapping
+    static constexpr bool jump_uses_vx = false;             // BXNN jumps to XNN + VX rather than NNN + V0
+    static constexpr bool superchip = false;                // Hi-res, scrolling, DXY0, FX30 and RPL flags
+    static constexpr bool xochip = false;                   // Long loads, register ranges, bitplanes, audio patterns
+    static constexpr uint32_t memory_size = 0x1000;         // Bytes of ram and decode_cache; PC and I-relative accesses wrap here
+    static constexpr uint32_t planes = 1;                   // Bitplanes the handlers draw, clear and scroll
+};
+
+template <> struct QUIRKS_T<SUPERCHIP> {
+    static constexpr bool vf_reset = false;
+    static constexpr bool shift_uses_vy = false;
+    static constexpr bool load_store_increments_i = false;
+    static constexpr bool clip_sprites = true;
+    static constexpr bool jump_uses_vx = true;
+    static constexpr bool superchip = true;
+    static constexpr bool xochip = false;
+    static constexpr uint32_t memory_size = 0x1000;
+    static constexpr uint32_t planes = 1;
+};
+
+template <> struct QUIRKS_T<XOCHIP> {
+    static constexpr bool vf_reset = false;
+    static constexpr bool shift_uses_vy = true;
+    static constexpr bool load_store_increments_i = true;
+    static constexpr bool clip_sprites = false;
+    static constexpr bool jump_uses_vx = false;
+    static constexpr bool superchip = true;
+    static constexpr bool xochip = true;
+    static constexpr uint32_t memory_size = RAM_SIZE;
+    static constexpr uint32_t planes = DISPLAY_PLANES;
+};
+
+// QUIRKS_T::memory_size of a quirk set picked at run time
+inline uint32_t memory_size(const EXTENSION_T ex) {
+    return ex == XOCHIP ? QUIRKS_T<XOCHIP>::memory_size : QUIRKS_T<CHIP8>::memory_size;
+}
+
+// Framebuffers are bit-packed: DISPLAY_WORDS words per row, the leftmost pixel in the top bit of the
+// first, so DXYN is a shift, AND and XOR per sprite row and scrolling moves rows or shifts words.
+// Lo-res (64x32, all of CHIP-8) uses the first word of the first 32 rows; SUPER-CHIP hi-res all 128x64.
+// Each XO-CHIP bitplane is a whole framebuffer of its own, so drawing into several planes repeats the
+// same word operations per plane; CHIP-8 and SUPER-CHIP only use plane 0. Read single pixels with display_pixel
+#define LORES_WIDTH 64
+#define LORES_HEIGHT 32
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_WORDS (DISPLAY_WIDTH / 64)
+#define DAMAGE_ALL (~(uint64_t)0)   // CHIP_8::damage when every row has to be redrawn
+#define STACK_DEPTH 16              // Subroutine levels, as SUPER-CHIP 1.1
+
+typedef uint64_t DISPLAY_ROW_T[DISPLAY_WORDS];
+
+inline bool display_pixel(const DISPLAY_ROW_T *display, const uint32_t x, const uint32_t y) {
+    return (display[y][x / 64] >> (63 - x % 64)) & 1;
+}
+
+// Bitplanes a quirk set shows: all of them for XO-CHIP, plane 0 for everything else
+inline uint32_t display_planes(const EXTENSION_T ex) {
+    return ex == XOCHIP ? QUIRKS_T<XOCHIP>::planes : QUIRKS_T<CHIP8>::planes;
+}
+
+struct CHIP_8;
+typedef void (*OPCODE_HANDLER_T)(CHIP_8 *chip8, const CONFIG_T &config);
+typedef void (*RUN_FN_T)(CHIP_8 *chip8, const CONFIG_T &config); // Runs chip8->cycles instructions
+
+struct DECODED_T {
+    INSTRUCTION_T inst;         // Operands extracted once at decode time
+    OPCODE_HANDLER_T handler;   // Opcode handler, nullptr until the address is decoded
+    OPCODE_T op;                // Handler index, used by the threaded engine
+    INSTRUCTION_T fused;        // Operands of the second opcode when op is a superinstruction
+};
+
+#ifdef CHIP8_HAS_JIT
+#define JIT_CODE_SIZE (1024 * 1024)     // Executable buffer for translated blocks
+#define JIT_MAX_BLOCKS 4096             // Translated blocks kept before the buffer is flushed
+#define JIT_MAX_BLOCK_LENGTH 64         // Opcodes per block
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_LENGTH * 2 + 2) // RAM a block reads; an XO-CHIP skip ending it reads one more opcode
+#define JIT_MAX_BLOCK_CODE 4096         // Upper bound on native bytes emitted for one block
+
+typedef void (*JIT_BLOCK_FN_T)(CHIP_8 *chip8);
+
+struct JIT_BLOCK_T {
+    JIT_BLOCK_FN_T fn;          // Native entry point
+    uint32_t bytes;             // CHIP-8 bytes covered, starting at the block address
+    uint32_t count;             // Instructions executed per run
+    bool loop_head;             // Starts an idle loop skip_idle_loop() can fast-forward
+};
+
+struct JIT_T {
+    uint8_t *code;                          // Executable code buffer
+    uint8_t *code_ptr;                      // Next free byte in code
+    JIT_BLOCK_T **blocks;                   // Translated block per start address, memory_size entries
+    uint32_t memory_size;                   // Addresses blocks covers, the quirk set's memory
+    JIT_BLOCK_T block_pool[JIT_MAX_BLOCKS]; // Storage for blocks
+    uint32_t block_count;                   // Used entries in block_pool
+};
+
+void jit_invalidate(JIT_T *jit, uint32_t address, uint32_t length);
+#endif
+
+#define AOT_MAX_BLOCK_LENGTH 64         // Opcodes per precompiled block
+#define AOT_MAX_BLOCK_BYTES (AOT_MAX_BLOCK_LENGTH * 2 + 2) // RAM a precompiled block reads, as for the JIT
+
+#ifdef CHIP8_AOT
+typedef void (*AOT_BLOCK_FN_T)(CHIP_8 *chip8, const CONFIG_T &config);
+
+struct AOT_BLOCK_T {
+    uint16_t address;           // CHIP-8 address the block starts at
+    uint16_t bytes;             // CHIP-8 bytes covered, starting at address
+    uint32_t count;             // Instructions executed per run
+    AOT_BLOCK_FN_T fn;          // Compiled block
+};
+
+struct AOT_T {
+    const AOT_BLOCK_T **blocks;          // Compiled block per start address, nullptr once overwritten; memory_size entries
+    bool *loop_head;                     // Block starts an idle loop skip_idle_loop() can fast-forward
+    uint32_t memory_size;                // Addresses blocks and loop_head cover, the quirk set's memory
+};
+
+// Emitted by chip8-aot into the generated translation unit
+extern const uint8_t aot_rom[];         // ROM image the blocks were compiled from
+extern const uint32_t aot_rom_size;
+extern const AOT_BLOCK_T aot_blocks[];
+extern const uint32_t aot_block_count;
+extern const EXTENSION_T aot_extension;  // Quirk set the blocks were specialised for
+#endif
+
+// Lockstep engine: LANES instances of one CHIP-8 ROM stepped together, one field array per register so
+// the compiler can turn each lane loop into vector operations. Lanes that share a PC and opcode run
+// together under a lane mask; lanes that diverge are run as further masked groups within the step
+enum LOCKSTEP_ISA_T {
+    LOCKSTEP_SCALAR,    // Baseline x86-64 build of the kernels
+    LOCKSTEP_AVX2,      // Same loops compiled with AVX2 enabled; no intrinsics
+    LOCKSTEP_AVX512,    // Same loops compiled with AVX-512F + BW enabled
+};
+
+template <uint32_t LANES>
+struct LOCKSTEP_T {
+    static_assert(LANES == 8 || LANES == 16 || LANES == 32, "8, 16 or 32 lanes");
+    alignas(64) uint8_t V[16][LANES];           // V[x][lane]
+    alignas(64) uint16_t PC[LANES];
+    alignas(64) uint16_t I[LANES];
+    alignas(64) uint8_t delay_timer[LANES];
+    alignas(64) uint16_t keypad[LANES];         // Bit k set while key k is down
+    alignas(64) uint8_t stack_depth[LANES];
+    alignas(64) uint16_t stack[STACK_DEPTH][LANES];
+    alignas(64) uint32_t rng[LANES];            // CXNN xorshift32 state, never 0
+    alignas(64) uint8_t anykey_pressed[LANES];  // FX0A state, as in CHIP_8
+    alignas(64) uint8_t key[LANES];
+    alignas(64) uint8_t ram[4096][LANES];       // ram[address][lane], CHIP-8's 4 KB: one load compares an opcode byte across lanes
+    alignas(64) uint64_t display[LANES][LORES_HEIGHT]; // One packed lo-res framebuffer per lane, word 0 of CHIP_8::display's rows
+    LOCKSTEP_ISA_T isa;                         // Kernel build to run; lockstep_init and lockstep_load_all pick the best the host has
+};
+
+// Load rom_name into every lane and reset them to the state init_chip8 gives a CHIP_8
+template <uint32_t LANES> bool lockstep_init(LOCKSTEP_T<LANES> *group, const char rom_name[]);
+// Copy a loaded CHIP-8 machine into every lane and pick the kernel build; lockstep_init without the ROM load
+template <uint32_t LANES> void lockstep_load_all(LOCKSTEP_T<LANES> *group, const CHIP_8 *chip8);
+// Copy one machine's state into lane, e.g. to restart a single lane from a freshly loaded CHIP_8
+template <uint32_t LANES> void lockstep_load(LOCKSTEP_T<LANES> *group, uint32_t lane, const CHIP_8 *chip8);
+// Run count instructions on every lane; each lane ends where count emulate_instructions calls would leave it.
+// CHIP-8 quirks only: false, with nothing run, for any other config.current_ex. With no sound FX18 does nothing
+template <uint32_t LANES> bool lockstep_run(LOCKSTEP_T<LANES> *group, const CONFIG_T &config, uint32_t count);
+template <uint32_t LANES> void lockstep_update_timers(LOCKSTEP_T<LANES> *group);
+
+#define X(lanes) \
+    extern template bool lockstep_init<lanes>(LOCKSTEP_T<lanes> *group, const char rom_name[]); \
+    extern template void lockstep_load_all<lanes>(LOCKSTEP_T<lanes> *group, const CHIP_8 *chip8); \
+    extern template void lockstep_load<lanes>(LOCKSTEP_T<lanes> *group, uint32_t lane, const CHIP_8 *chip8); \
+    extern template bool lockstep_run<lanes>(LOCKSTEP_T<lanes> *group, const CONFIG_T &config, uint32_t count); \
+    extern template void lockstep_update_timers<lanes>(LOCKSTEP_T<lanes> *group);
+X(8) X(16) X(32)
+#undef X
+
+// Save states: every field of the machine a ROM can observe, in a fixed little-endian layout with
+// no pointers, so a state saved by one build restores bit-exactly in any other. save_state and
+// load_state are plain copies for in-memory snapshots; the checksum is filled in and checked only
+// by the file functions (F5/F9, --load-state). CHIP-8 and SUPER-CHIP states stop before the XO-CHIP
+// tail (savestate_size), so saving, checksumming, writing and rewinding them touch some 5 KB
+#define SAVESTATE_MAGIC 0x53533843      // "C8SS"
+#define SAVESTATE_VERSION 6             // 6: quirk set recorded; 5: XO-CHIP memory and planes 1-3 in a tail
+
+struct SAVESTATE_T {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t extension;          // EXTENSION_T saved with; only a machine with the same quirks loads it
+    uint8_t reserved;           // Zero
+    uint64_t checksum;          // 64-bit FNV-1a of the bytes after this field, up to size
+    uint32_t size;              // savestate_size() of the machine's quirk set: bytes in use from the start
+    uint32_t rng;
+    uint8_t ram[0x1000];        // The 4 KB every quirk set addresses
+    DISPLAY_ROW_T display[DISPLAY_HEIGHT]; // Plane 0's packed rows, as CHIP_8::display[0]
+    uint16_t stack[STACK_DEPTH];
+    uint16_t I;
+    uint16_t PC;
+    uint8_t V[16];
+    uint8_t keypad[16];
+    uint8_t rpl[16];
+    uint8_t audio_pattern[16];
+    uint8_t stack_depth;        // Entries in use, stack_ptr - stack
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t anykey_pressed;     // FX0A wait state
+    uint8_t key;
+    uint8_t hires;
+    uint8_t planes;
+    uint8_t pitch;
+    uint8_t padding[4];         // Zero
+    // XO-CHIP only
+    uint8_t xo_ram[RAM_SIZE - 0x1000];                      // Memory past 4 KB
+    DISPLAY_ROW_T xo_display[DISPLAY_PLANES - 1][DISPLAY_HEIGHT]; // Planes 1-3
+};
+
+// Bytes of SAVESTATE_T a quirk set's states use
+inline uint32_t savestate_size(const EXTENSION_T ex) {
+    return ex == XOCHIP ? sizeof(SAVESTATE_T) : offsetof(SAVESTATE_T, xo_ram);
+}
+
+// Execution recording (--record): a memory-mapped file holding RECORD_HEADER_T followed by a ring
+// of capacity RECORD_Ts, one per executed instruction. Read back with chip8-trace
+#define RECORD_MAGIC 0x52543843         // "C8TR"
+#define RECORD_VERSION 1
+#define RECORD_I 0x10                   // RECORD_T::changed for the index register
+#define RECORD_NONE 0xFF                // RECORD_T::changed when no register changed
+
+struct RECORD_HEADER_T {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;       // sizeof(RECORD_T)
+    uint32_t capacity;          // Records in the ring
+    uint32_t reserved;
+    uint64_t total;             // Records ever written; the newest is at (total - 1) % capacity
+};
+
+struct RECORD_T {
+    uint64_t counter;           // Instructions executed before this one
+    uint16_t PC;                // Address the opcode was fetched from
+    uint16_t opcode;
+    uint8_t changed;            // V register index, RECORD_I or RECORD_NONE
+    uint8_t reserved;
+    uint16_t value;             // New value of the changed register
+};
+
+struct RECORDER_T;
+
+// Movies (--movie-record/--movie-play): MOVIE_HEADER_T, then in the order they happened, keypad
+// changes (tag MOVIE_KEY | down << 4 | key, then the LEB128 instruction count since the previous
+// change) and one MOVIE_FRAME tag plus the low 32 bits of display_hash, little-endian, per 60 Hz frame.
+// Playback applies each change at the exact instruction it was recorded at and compares the checksums
+#define MOVIE_MAGIC 0x564D3843          // "C8MV"
+#define MOVIE_VERSION 6                 // 6: version 6 save states in the start checksum
+#define MOVIE_KEY 0x00                  // 0x00-0x1F: keypad change
+#define MOVIE_FRAME 0x80
+
+struct MOVIE_HEADER_T {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t extension;          // EXTENSION_T recorded with
+    uint8_t reserved;
+    uint32_t seed;              // CXNN state at the first instruction
+    uint32_t clock_rate;        // Instructions per 60 Hz frame follow from this
+    uint64_t state_hash;        // SAVESTATE_T checksum at the first instruction, to catch a different ROM or start
+};
+
+struct MOVIE_T;
+
+// Profiling (--profile): main loop phases timed per frame
+enum PROFILE_PHASE_T {
+    PHASE_INPUT,        // handle_input and waiting for a frame (window thread)
+    PHASE_EMULATE,      // run_instructions (emulation thread)
+    PHASE_SLEEP,        // Waiting for the next timer or display tick (emulation thread)
+    PHASE_RENDER,       // update_screen (window thread)
+    PHASE_TIMERS,       // update_timers and publishing frames (emulation thread)
+    PHASE_COUNT,
+};
+
+struct PROFILER_T {
+    uint64_t *pc_counts;                // Instructions executed per address, memory_size entries
+    OPCODE_T *pc_ops;                   // Opcode class last executed at each address
+    uint32_t memory_size;               // Addresses counted, the quirk set's memory
+    uint64_t op_counts[OP_COUNT];       // Instructions executed per opcode class
+    uint64_t phase_ticks[PHASE_COUNT];  // Performance counter ticks spent per phase
+    uint64_t frames;
+};
+
+#define CHIP8_RNG_SEED 0x2545F491 // CXNN state after init_chip8
+
+struct CHIP_8 {
+    EMULATOR_STATE_T state;     // Current state of the CHIP-8 machine
+    EXTENSION_T extension;      // Quirk set, fixed by init_chip8; sizes ram and decode_cache and picks the engine build
+    uint8_t *ram;               // Random Access Memory, memory_size(extension) bytes: 4 KB, or 64 KB for XO-CHIP
+    DISPLAY_ROW_T display[DISPLAY_PLANES][DISPLAY_HEIGHT]; // CHIP-8 pixels, one packed framebuffer per bitplane; only XO-CHIP draws past plane 0
+    uint64_t damage;            // Bit y set once display row y changes; cleared when the window takes the frame
+    bool hires;                 // SUPER-CHIP 128x64 mode (00FF) rather than 64x32
+    uint8_t planes;             // XO-CHIP bitplanes FN01 selected for drawing, clearing and scrolling, bit p for plane p
+    uint16_t stack[STACK_DEPTH]; // Subroutine stack (16 16-bytes)
+    uint16_t *stack_ptr;        // Subroutine stack pointer
+    uint8_t V[16];              // Data Registers V0-VF (16 8-bytes)
+    uint8_t rpl[16];            // SUPER-CHIP RPL user flags (FX75/FX85)
+    uint16_t I;                 // Index Register
+    uint16_t PC;                // Program Counter
+    uint8_t delay_timer;        // Decrements at 60 hz when > 0
+    uint8_t sound_timer;        // Decrements at 60 hz when > 0; the pattern plays while it does
+    uint8_t audio_pattern[16];  // 128 one-bit samples, looped; XO-CHIP loads its own with F002
+    uint8_t pitch;              // Pattern rate, 4000 * 2^((pitch - 64) / 48) samples per second (FX3A)
+    bool keypad[16];            // Hexadecimal keypad 0x0-0xF
+    bool anykey_pressed;        // FX0A saw key go down and is waiting for its release
+    uint8_t key;                // Key FX0A is waiting on
+    uint32_t rng;               // CXNN xorshift32 state, never 0
+    const char *rom_name;       // Running ROM
+    INSTRUCTION_T inst;         // Executing Instruction
+    DECODED_T *decode_cache;    // Pre-decoded instruction per RAM address, memory_size(extension) entries
+    RUN_FN_T run;               // Engine instantiation for this machine's quirk set, picked on first run
+    uint32_t cycles;            // Instructions left in the current run_instructions batch
+#ifdef CHIP8_HAS_JIT
+    JIT_T *jit;                 // Native code cache, created on first JIT run
+#endif
+#ifdef CHIP8_AOT
+    AOT_T *aot;                 // Precompiled block lookup, created on first AOT run
+#endif
+    RECORDER_T *recorder;       // Execution trace ring, from record_open()
+    MOVIE_T *movie;             // Keypad movie being recorded or played, from movie_record()/movie_play()
+    uint64_t instructions;      // Executed since the machine started; what movie keypad changes are stamped with
+    PROFILER_T *profiler;       // Execution counts and phase timings, when profiling
+};
+
+// Split opcode into its operand fields
+inline INSTRUCTION_T decode_operands(const uint16_t opcode) {
+    return {
+            .opcode = opcode,
+            .NNN = (uint16_t)(opcode & 0x0FFF),       // Extract the lowest 12 bits of opcode and store in NNN (High-Bit)
+            .NN = (uint8_t)(opcode & 0x0FF),          // Extract the lowest 8 bits of opcode and store in NN (Middle-Bit)
+            .N = (uint8_t)(opcode & 0x0F),            // Extract the lowest 4 bits of opcode and store in N (Low-Bit)
+            .X = (uint8_t)((opcode >> 8) & 0x0F),     // Right shift opcode by 8 positions, then extract the lowest 4 bits and store in X
+            .Y = (uint8_t)((opcode >> 4) & 0x0F),     // Right shift opcode by 4 positions, then extract the lowest 4 bits and store in Y
+    };
+}
+
+// Pick the handler for an opcode; walked once per address, then served from the decode cache
+inline OPCODE_T decode_opcode(const INSTRUCTION_T inst) {
+    switch ((inst.opcode >> 12) & 0x0F) { // Extract 4 LSB and mask with 15
+        case 0x00:
+            if (inst.Y == 0xC) return OP_00CN;
+            if (inst.Y == 0xD) return OP_00DN;
+            switch (inst.NN) {
+                case 0xE0: return OP_00E0;
+                case 0xEE: return OP_00EE;
+                case 0xFB: return OP_00FB;
+                case 0xFC: return OP_00FC;
+                case 0xFD: return OP_00FD;
+                case 0xFE: return OP_00FE;
+                case 0xFF: return OP_00FF;
+                default: return OP_invalid;
+            }
+        case 0x01: return OP_1NNN;
+        case 0x02: return OP_2NNN;
+        case 0x03: return OP_3XNN;
+        case 0x04: return OP_4XNN;
+        case 0x05:
+            switch (inst.N) {
+                case 0: return OP_5XY0;
+                case 2: return OP_5XY2;
+                case 3: return OP_5XY3;
+                default: return OP_invalid;
+            }
+        case 0x06: return OP_6XNN;
+        case 0x07: return OP_7XNN;
+        case 0x08:
+            switch (inst.N) {
+                case 0: return OP_8XY0;
+                case 1: return OP_8XY1;
+                case 2: return OP_8XY2;
+                case 3: return OP_8XY3;
+                case 4: return OP_8XY4;
+                case 5: return OP_8XY5;
+                case 6: return OP_8XY6;
+                case 7: return OP_8XY7;
+                case 0xE: return OP_8XYE;
+                default: return OP_invalid;
+            }
+        case 0x09: return OP_9XY0;
+        case 0x0A: return OP_ANNN;
+        case 0x0B: return OP_BNNN;
+        case 0x0C: return OP_CXNN;
+        case 0x0D: return OP_DXYN;
+        case 0x0E:
+            if (inst.NN == 0x9E) return OP_EX9E;
+            if (inst.NN == 0xA1) return OP_EXA1;
+            return OP_invalid;
+        case 0x0F:
+            switch (inst.NN) {
+                case 0x00: return inst.X == 0 ? OP_F000 : OP_invalid;
+                case 0x01: return OP_FN01;
+                case 0x02: return inst.X == 0 ? OP_F002 : OP_invalid;
+                case 0x07: return OP_FX07;
+                case 0x0A: return OP_FX0A;
+                case 0x15: return OP_FX15;
+                case 0x18: return OP_FX18;
+                case 0x1E: return OP_FX1E;
+                case 0x29: return OP_FX29;
+                case 0x30: return OP_FX30;
+                case 0x33: return OP_FX33;
+                case 0x3A: return OP_FX3A;
+                case 0x55: return OP_FX55;
+                case 0x65: return OP_FX65;
+                case 0x75: return OP_FX75;
+                case 0x85: return OP_FX85;
+                default: return OP_invalid;
+            }
+        default: return OP_invalid; // Invalid opcode
+    }
+}
+
+// Opcode handlers, one per OPCODE_T, instantiated for every QUIRKS_T
+#define X(name) template <typename QUIRKS> void op_##name(CHIP_8 *chip8, const CONFIG_T &config); \
+                extern template void op_##name<QUIRKS_T<CHIP8>>(CHIP_8 *chip8, const CONFIG_T &config); \
+                extern template void op_##name<QUIRKS_T<SUPERCHIP>>(CHIP_8 *chip8, const CONFIG_T &config); \
+                extern template void op_##name<QUIRKS_T<XOCHIP>>(CHIP_8 *chip8, const CONFIG_T &config);
+CHIP8_OPCODES(X)
+#undef X
+
+bool set_config_from_args(CONFIG_T *config, int argc, const char **argv);
+bool init_chip8(CHIP_8 *chip8, const char rom_name[], EXTENSION_T ex);
+void destroy_chip8(CHIP_8 *chip8);
+void update_timers(CHIP_8 *chip8);
+uint64_t display_hash(const CHIP_8 *chip8);
+void save_state(const CHIP_8 *chip8, SAVESTATE_T *state);
+bool load_state(CHIP_8 *chip8, const SAVESTATE_T *state);
+bool write_state_file(const char *path, const CHIP_8 *chip8);
+bool read_state_file(const char *path, CHIP_8 *chip8);
+void invalidate_decode_cache(CHIP_8 *chip8, uint32_t address, uint32_t length);
+void emulate_instructions(CHIP_8 *chip8, const CONFIG_T &config);
+void run_instructions(CHIP_8 *chip8, const CONFIG_T &config, uint32_t count);
+RECORDER_T *record_open(const char *path, uint32_t capacity);
+void record_close(CHIP_8 *chip8);
+MOVIE_T *movie_record(const char *path, const CHIP_8 *chip8, const CONFIG_T &config);
+MOVIE_T *movie_play(const char *path, CHIP_8 *chip8, CONFIG_T *config);
+bool movie_key(CHIP_8 *chip8, uint8_t key, bool down);
+void movie_frame(CHIP_8 *chip8);
+uint32_t movie_apply(CHIP_8 *chip8, uint32_t count);
+bool movie_finished(const CHIP_8 *chip8);
+bool movie_desynced(const CHIP_8 *chip8);
+void movie_close(CHIP_8 *chip8);
+
+#endif
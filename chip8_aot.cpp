@@ -0,0 +1,217 @@
+// chip8-aot: static recompiler from a CHIP-8 ROM to a C++ translation unit.
+// Walks reachable code from the entry point by following jumps, calls and skips, and emits one
+// function per basic block that operates on CHIP_8 directly. Link the output into an emulator
+// built with CHIP8_AOT (see chip8_add_aot_rom in CMakeLists.txt); anything not reached here,
+// computed jumps (BNNN) and code the ROM overwrites at runtime fall back to emulate_instructions.
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <vector>
+#include "KOBZ_CHIP8PLUS.h"
+using namespace std;
+
+struct ROM_T {
+    uint8_t ram[RAM_SIZE];      // ROM image at its load address
+    uint32_t end;               // One past the last ROM byte
+    bool xochip;                // Skips jump over a whole F000 NNNN
+};
+
+// Is there a whole opcode at addr?
+static bool in_rom(const ROM_T &rom, const uint32_t addr) { return addr >= 0x200 && addr + 1 < rom.end; }
+
+static INSTRUCTION_T fetch(const ROM_T &rom, const uint16_t addr) {
+    return decode_operands((rom.ram[addr] << 8) | rom.ram[addr + 1]);
+}
+
+// Where a skip at addr lands when taken
+static uint16_t skip_target(const ROM_T &rom, const uint16_t addr) {
+    const uint16_t next = addr + 2;
+    const bool long_load = rom.xochip && in_rom(rom, next) && rom.ram[next] == 0xF0 && rom.ram[next + 1] == 0x00;
+    return next + (long_load ? 4 : 2);
+}
+
+// Does this opcode end a basic block? Successor addresses are added to leaders
+static bool ends_block(const ROM_T &rom, const OPCODE_T op, const INSTRUCTION_T inst, const uint16_t addr, vector<uint16_t> *leaders) {
+    const uint16_t next = addr + 2;
+    switch (op) {
+        case OP_1NNN: leaders->push_back(inst.NNN); return true;
+        case OP_2NNN: leaders->push_back(inst.NNN); leaders->push_back(next); return true;
+        case OP_3XNN: case OP_4XNN: case OP_5XY0: case OP_9XY0: case OP_EX9E: case OP_EXA1:
+            leaders->push_back(next); leaders->push_back(skip_target(rom, addr)); return true;
+        case OP_F000: leaders->push_back(next + 2); return true; // Operand word isn't code
+        case OP_FX0A: case OP_FX33: case OP_FX55: case OP_5XY2: case OP_00FD:
+            leaders->push_back(next); return true; // PC may rewind / RAM may change under the block
+        case OP_00EE: case OP_BNNN: return true;   // Target only known at runtime
+        default: return false;
+    }
+}
+
+// Emit C++ for one opcode; terminators leave PC set and return
+static void emit_opcode(FILE *out, const ROM_T &rom, const OPCODE_T op, const INSTRUCTION_T inst, const uint16_t addr) {
+    const unsigned X = inst.X, Y = inst.Y, NN = inst.NN, NNN = inst.NNN, next = addr + 2u, skip = skip_target(rom, addr);
+    fprintf(out, "    // %03X: %04X\n", addr, inst.opcode);
+    switch (op) {
+        case OP_6XNN: fprintf(out, "    V[0x%X] = 0x%02X;\n", X, NN); break;
+        case OP_7XNN: fprintf(out, "    V[0x%X] += 0x%02X;\n", X, NN); break;
+        case OP_8XY0: fprintf(out, "    V[0x%X] = V[0x%X];\n", X, Y); break;
+        case OP_8XY1: case OP_8XY2: case OP_8XY3:
+            fprintf(out, "    V[0x%X] %c= V[0x%X];\n", X, op == OP_8XY1 ? '|' : op == OP_8XY2 ? '&' : '^', Y);
+            fprintf(out, "    if constexpr (QUIRKS::vf_reset) V[0xF] = 0;\n");
+            break;
+        case OP_8XY4:
+            fprintf(out, "    carry = (uint16_t)(V[0x%X] + V[0x%X]) > 255;\n", X, Y);
+            fprintf(out, "    V[0x%X] += V[0x%X];\n    V[0xF] = carry;\n", X, Y);
+            break;
+        case OP_8XY5:
+            fprintf(out, "    carry = V[0x%X] <= V[0x%X];\n", Y, X);
+            fprintf(out, "    V[0x%X] -= V[0x%X];\n    V[0xF] = carry;\n", X, Y);
+            break;
+        case OP_8XY7:
+            fprintf(out, "    carry = V[0x%X] <= V[0x%X];\n", X, Y);
+            fprintf(out, "    V[0x%X] = V[0x%X] - V[0x%X];\n    V[0xF] = carry;\n", X, Y, X);
+            break;
+        case OP_8XY6:
+            fprintf(out, "    if constexpr (QUIRKS::shift_uses_vy) { carry = V[0x%X] & 1; V[0x%X] = V[0x%X] >> 1; }\n", Y, X, Y);
+            fprintf(out, "    else { carry = V[0x%X] & 1; V[0x%X] >>= 1; }\n    V[0xF] = carry;\n", X, X);
+            break;
+        case OP_8XYE:
+            fprintf(out, "    if constexpr (QUIRKS::shift_uses_vy) { carry = (V[0x%X] & 0x80) >> 7; V[0x%X] = V[0x%X] << 1; }\n", Y, X, Y);
+            fprintf(out, "    else { carry = (V[0x%X] & 0x80) >> 7; V[0x%X] <<= 1; }\n    V[0xF] = carry;\n", X, X);
+            break;
+        case OP_ANNN: fprintf(out, "    chip8->I = 0x%03X;\n", NNN); break;
+        case OP_FX07: fprintf(out, "    V[0x%X] = chip8->delay_timer;\n", X); break;
+        case OP_FX15: fprintf(out, "    chip8->delay_timer = V[0x%X];\n", X); break;
+        case OP_FX18: fprintf(out, "    chip8->sound_timer = V[0x%X];\n", X); break;
+        case OP_FX1E: fprintf(out, "    chip8->I += V[0x%X];\n", X); break;
+        case OP_FX29: fprintf(out, "    chip8->I = V[0x%X] * 5;\n", X); break;
+
+        case OP_1NNN: fprintf(out, "    chip8->PC = 0x%03X;\n    return;\n", NNN); break;
+        case OP_2NNN: fprintf(out, "    *chip8->stack_ptr++ = 0x%03X;\n    chip8->PC = 0x%03X;\n    return;\n", next, NNN); break;
+        case OP_00EE: fprintf(out, "    chip8->PC = *--chip8->stack_ptr;\n    return;\n"); break;
+        case OP_BNNN: fprintf(out, "    chip8->PC = V[QUIRKS::jump_uses_vx ? 0x%X : 0] + 0x%03X;\n    return;\n", X, NNN); break;
+        case OP_3XNN: fprintf(out, "    chip8->PC = V[0x%X] == 0x%02X ? 0x%03X : 0x%03X;\n    return;\n", X, NN, skip, next); break;
+        case OP_4XNN: fprintf(out, "    chip8->PC = V[0x%X] != 0x%02X ? 0x%03X : 0x%03X;\n    return;\n", X, NN, skip, next); break;
+        case OP_5XY0: fprintf(out, "    chip8->PC = V[0x%X] == V[0x%X] ? 0x%03X : 0x%03X;\n    return;\n", X, Y, skip, next); break;
+        case OP_9XY0: fprintf(out, "    chip8->PC = V[0x%X] != V[0x%X] ? 0x%03X : 0x%03X;\n    return;\n", X, Y, skip, next); break;
+        case OP_EX9E: fprintf(out, "    chip8->PC = chip8->keypad[V[0x%X]] ? 0x%03X : 0x%03X;\n    return;\n", X, skip, next); break;
+        case OP_EXA1: fprintf(out, "    chip8->PC = !chip8->keypad[V[0x%X]] ? 0x%03X : 0x%03X;\n    return;\n", X, skip, next); break;
+
+        default: {
+            // Drawing, RNG, key wait and memory ops go through the interpreter's handlers
+            static const char *const names[OP_COUNT] = {
+#define X(name) #name,
+                CHIP8_OPCODES(X)
+#undef X
+            };
+            fprintf(out, "    chip8->inst = decode_operands(0x%04X);\n    chip8->PC = 0x%03X;\n", inst.opcode, next);
+            fprintf(out, "    op_%s<QUIRKS>(chip8, config);\n", names[op]);
+            if (op == OP_FX0A || op == OP_FX33 || op == OP_FX55 || op == OP_5XY2 || op == OP_F000 || op == OP_00FD)
+                fprintf(out, "    return;\n");
+            break;
+        }
+    }
+}
+
+struct BLOCK_T {
+    uint16_t address;
+    uint16_t bytes;
+    uint32_t count;
+};
+
+// Emit the block starting at leader; returns its extent, or count 0 if nothing there is code
+static BLOCK_T emit_block(FILE *out, const ROM_T &rom, const uint16_t leader, vector<uint16_t> *leaders) {
+    BLOCK_T block = {leader, 0, 0};
+    uint16_t addr = leader;
+    bool terminated = false;
+
+    // Measure first so empty blocks emit nothing
+    vector<pair<uint16_t, INSTRUCTION_T>> body;
+    while (!terminated && body.size() < AOT_MAX_BLOCK_LENGTH && in_rom(rom, addr)) {
+        const INSTRUCTION_T inst = fetch(rom, addr);
+        const OPCODE_T op = decode_opcode(inst);
+        if (op == OP_invalid) break; // Most likely data; the interpreter handles it if it's ever reached
+        terminated = ends_block(rom, op, inst, addr, leaders);
+        body.push_back({addr, inst});
+        addr += 2;
+    }
+    if (body.empty()) return block;
+    if (!terminated && in_rom(rom, addr)) leaders->push_back(addr); // Split at the length limit
+
+    fprintf(out, "static void aot_block_%03X(CHIP_8 *chip8, const CONFIG_T &config) {\n", leader);
+    fprintf(out, "    (void)config;\n    [[maybe_unused]] uint8_t *const V = chip8->V;\n    [[maybe_unused]] bool carry;\n");
+    for (const auto &[op_addr, inst] : body) emit_opcode(out, rom, decode_opcode(inst), inst, op_addr);
+    if (!terminated) fprintf(out, "    chip8->PC = 0x%03X;\n", addr);
+    fprintf(out, "}\n\n");
+
+    block.bytes = addr - leader + (rom.xochip && terminated ? 2 : 0); // An XO-CHIP skip also read the opcode after it
+    block.count = (uint32_t)body.size();
+    return block;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s <rom_name> <output.cpp> [chip8|superchip|xochip]\n", argv[0]);
+        exit(EXIT_FAILURE); }
+
+    // Quirk set the blocks are specialised for; the emulator must run with the same --quirks
+    const char *quirks = argc == 4 ? argv[3] : "chip8";
+    const char *extension;
+    EXTENSION_T ex;
+    if (strcmp(quirks, "chip8") == 0) { extension = "CHIP8"; ex = CHIP8; }
+    else if (strcmp(quirks, "superchip") == 0) { extension = "SUPERCHIP"; ex = SUPERCHIP; }
+    else if (strcmp(quirks, "xochip") == 0) { extension = "XOCHIP"; ex = XOCHIP; }
+    else {
+        fprintf(stderr, "Unknown quirk set %s (expected chip8, superchip or xochip)\n", quirks);
+        exit(EXIT_FAILURE); }
+
+    static ROM_T rom = {};
+    rom.xochip = ex == XOCHIP;
+    const size_t max_size = memory_size(ex) - 0x200;
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "ROM file %s is invalid or does not exist\n", argv[1]);
+        exit(EXIT_FAILURE); }
+    const size_t rom_size = fread(&rom.ram[0x200], 1, max_size, in);
+    const bool too_big = fgetc(in) != EOF;
+    fclose(in);
+    if (too_big) {
+        fprintf(stderr, "Rom file %s is too big! Max Size Allowed: %zu\n", argv[1], max_size);
+        exit(EXIT_FAILURE); }
+    rom.end = 0x200 + (uint32_t)rom_size;
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "Could not open %s for writing: %s\n", argv[2], strerror(errno));
+        exit(EXIT_FAILURE); }
+
+    fprintf(out, "// Generated by chip8-aot from %s. Do not edit.\n", argv[1]);
+    fprintf(out, "#include \"KOBZ_CHIP8PLUS.h\"\n\n");
+    fprintf(out, "using QUIRKS = QUIRKS_T<%s>;\nconst EXTENSION_T aot_extension = %s;\n\n", extension, extension);
+    fprintf(out, "const uint8_t aot_rom[] = {");
+    for (size_t i = 0; i < rom_size; i++) fprintf(out, "%s0x%02X,", i % 16 ? " " : "\n    ", rom.ram[0x200 + i]);
+    fprintf(out, "\n};\nconst uint32_t aot_rom_size = %zu;\n\n", rom_size);
+
+    // Recursive descent from the entry point
+    vector<uint16_t> leaders = {0x200};
+    set<uint16_t> visited;
+    vector<BLOCK_T> blocks;
+    while (!leaders.empty()) {
+        const uint16_t leader = leaders.back();
+        leaders.pop_back();
+        if (!in_rom(rom, leader) || !visited.insert(leader).second) continue;
+        const BLOCK_T block = emit_block(out, rom, leader, &leaders);
+        if (block.count) blocks.push_back(block);
+    }
+
+    fprintf(out, "const AOT_BLOCK_T aot_blocks[] = {\n");
+    for (const BLOCK_T &block : blocks)
+        fprintf(out, "    {0x%03X, %u, %u, aot_block_%03X},\n", block.address, block.bytes, block.count, block.address);
+    if (blocks.empty()) fprintf(out, "    {0, 0, 0, nullptr},\n");
+    fprintf(out, "};\nconst uint32_t aot_block_count = %zu;\n", blocks.size());
+    fclose(out);
+
+    printf("%s: %zu blocks compiled\n", argv[2], blocks.size());
+    return EXIT_SUCCESS;
+}
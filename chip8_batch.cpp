@@ -0,0 +1,235 @@
+// chip8-batch: runs many ROMs headlessly across all cores and reports their final state.
+//   chip8-batch <manifest> [--threads <n>]
+// Manifest lines are "<frames> <quirks> <input-script|-> <rom>", the ROM path taking the rest of the
+// line; blank lines and lines starting with # are skipped. Input scripts hold "<frame> down|up <key>"
+// lines (key in hex), applied before that frame runs. Jobs are dealt round-robin to one deque per
+// worker; a worker that runs dry steals from the far end of another's, so a few long ROMs don't
+// leave the other cores idle.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "KOBZ_CHIP8PLUS.h"
+using namespace std;
+
+struct INPUT_STEP_T {
+    uint64_t frame;             // Applied before this frame runs
+    uint8_t key;                // Keypad value 0x0-0xF
+    bool down;
+};
+
+struct JOB_T {
+    string rom;
+    string quirks_name;
+    EXTENSION_T quirks;
+    uint64_t frames;
+    vector<INPUT_STEP_T> input; // Sorted by frame
+
+    bool ok;                    // ROM loaded and ran
+    uint64_t instructions;
+    double seconds;
+    uint64_t state_hash;        // RAM, registers, stack, timers, display and audio
+    uint64_t display_hash;      // As reported by --headless
+};
+
+struct WORKER_QUEUE_T {
+    mutex lock;
+    deque<size_t> jobs;         // Indices into the job list; owner takes the back, thieves the front
+};
+
+static bool parse_quirks(const char *name, EXTENSION_T *quirks) {
+    if (strcmp(name, "chip8") == 0) *quirks = CHIP8;
+    else if (strcmp(name, "superchip") == 0) *quirks = SUPERCHIP;
+    else if (strcmp(name, "xochip") == 0) *quirks = XOCHIP;
+    else return false;
+    return true;
+}
+
+static bool load_input(const char *path, vector<INPUT_STEP_T> *input) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Could not open input script %s: %s\n", path, strerror(errno));
+        return false; }
+
+    char line[256];
+    for (int number = 1; fgets(line, sizeof line, in); number++) {
+        unsigned long long frame;
+        char action[8];
+        unsigned key;
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#') continue;
+        if (sscanf(line, "%llu %7s %x", &frame, action, &key) != 3 || key > 0xF ||
+            (strcmp(action, "down") != 0 && strcmp(action, "up") != 0)) {
+            fprintf(stderr, "%s:%d: expected \"<frame> down|up <key>\"\n", path, number);
+            fclose(in);
+            return false; }
+        input->push_back({frame, (uint8_t)key, strcmp(action, "down") == 0});
+    }
+    fclose(in);
+    stable_sort(input->begin(), input->end(), [](const INPUT_STEP_T &a, const INPUT_STEP_T &b) { return a.frame < b.frame; });
+    return true;
+}
+
+static bool load_manifest(const char *path, vector<JOB_T> *jobs) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Could not open manifest %s: %s\n", path, strerror(errno));
+        return false; }
+
+    char line[4096];
+    for (int number = 1; fgets(line, sizeof line, in); number++) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[strspn(line, " \t")] == '\0' || line[0] == '#') continue;
+
+        JOB_T job = {};
+        unsigned long long frames;
+        char quirks[32], input[1024];
+        int rom_start = 0;
+        if (sscanf(line, "%llu %31s %1023s %n", &frames, quirks, input, &rom_start) != 3 || !line[rom_start]) {
+            fprintf(stderr, "%s:%d: expected \"<frames> <quirks> <input-script|-> <rom>\"\n", path, number);
+            fclose(in);
+            return false; }
+        if (!parse_quirks(quirks, &job.quirks)) {
+            fprintf(stderr, "%s:%d: unknown quirk set %s (expected chip8, superchip or xochip)\n", path, number, quirks);
+            fclose(in);
+            return false; }
+        if (strcmp(input, "-") != 0 && !load_input(input, &job.input)) {
+            fclose(in);
+            return false; }
+
+        job.rom = &line[rom_start];
+        job.quirks_name = quirks;
+        job.frames = frames;
+        jobs->push_back(move(job));
+    }
+    fclose(in);
+    return true;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, const size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    } return hash;
+}
+
+static uint64_t state_hash(const CHIP_8 *chip8) {
+    const uint8_t depth = (uint8_t)(chip8->stack_ptr - chip8->stack);
+    uint64_t hash = 0xCBF29CE484222325;
+    hash = fnv1a(hash, chip8->ram, memory_size(chip8->extension));
+    hash = fnv1a(hash, chip8->display, display_planes(chip8->extension) * sizeof chip8->display[0]);
+    hash = fnv1a(hash, &chip8->hires, sizeof chip8->hires);
+    hash = fnv1a(hash, &chip8->planes, sizeof chip8->planes);
+    hash = fnv1a(hash, chip8->V, sizeof chip8->V);
+    hash = fnv1a(hash, &chip8->I, sizeof chip8->I);
+    hash = fnv1a(hash, &chip8->PC, sizeof chip8->PC);
+    hash = fnv1a(hash, &depth, sizeof depth);
+    hash = fnv1a(hash, chip8->stack, depth * sizeof chip8->stack[0]);
+    hash = fnv1a(hash, chip8->rpl, sizeof chip8->rpl);
+    hash = fnv1a(hash, chip8->audio_pattern, sizeof chip8->audio_pattern);
+    hash = fnv1a(hash, &chip8->pitch, sizeof chip8->pitch);
+    hash = fnv1a(hash, &chip8->sound_timer, sizeof chip8->sound_timer);
+    return fnv1a(hash, &chip8->delay_timer, sizeof chip8->delay_timer);
+}
+
+// Same frame loop as --headless, with the job's input script applied between frames
+static void run_job(JOB_T *job) {
+    CONFIG_T config;
+    const char *args[] = {"chip8-batch"};
+    set_config_from_args(&config, 1, args);
+    config.current_ex = job->quirks;
+
+    CHIP_8 *chip8 = new CHIP_8();
+    if (!init_chip8(chip8, job->rom.c_str(), job->quirks)) {
+        destroy_chip8(chip8);
+        delete chip8;
+        return; }
+
+    const auto start = chrono::steady_clock::now();
+    size_t step = 0;
+    for (uint64_t frame = 0; frame < job->frames; frame++) {
+        for (; step < job->input.size() && job->input[step].frame <= frame; step++)
+            chip8->keypad[job->input[step].key] = job->input[step].down;
+        const uint32_t count = (uint32_t)((frame + 1) * config.clock_rate / 60 - frame * config.clock_rate / 60);
+        run_instructions(chip8, config, count);
+        job->instructions += count;
+        update_timers(chip8);
+    }
+    job->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    job->state_hash = state_hash(chip8);
+    job->display_hash = display_hash(chip8);
+    job->ok = true;
+    destroy_chip8(chip8);
+    delete chip8;
+}
+
+// Own deque first, newest job; then steal the oldest job from the others
+static bool next_job(vector<WORKER_QUEUE_T> &queues, const size_t self, size_t *job) {
+    for (size_t i = 0; i < queues.size(); i++) {
+        WORKER_QUEUE_T &queue = queues[(self + i) % queues.size()];
+        lock_guard<mutex> guard(queue.lock);
+        if (queue.jobs.empty()) continue;
+        if (i == 0) {
+            *job = queue.jobs.back();
+            queue.jobs.pop_back();
+        } else {
+            *job = queue.jobs.front();
+            queue.jobs.pop_front();
+        } return true;
+    } return false; // Jobs never add jobs, so every deque empty means done
+}
+
+static void worker(vector<WORKER_QUEUE_T> *queues, vector<JOB_T> *jobs, const size_t self) {
+    size_t job;
+    while (next_job(*queues, self, &job)) run_job(&(*jobs)[job]);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2 && !(argc == 4 && strcmp(argv[2], "--threads") == 0)) {
+        fprintf(stderr, "Usage: %s <manifest> [--threads <n>]\n", argv[0]);
+        exit(EXIT_FAILURE); }
+
+    vector<JOB_T> jobs;
+    if (!load_manifest(argv[1], &jobs)) exit(EXIT_FAILURE);
+
+    size_t thread_count = argc == 4 ? strtoul(argv[3], nullptr, 10) : thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 1;
+    if (thread_count > jobs.size()) thread_count = jobs.size() ? jobs.size() : 1;
+
+    vector<WORKER_QUEUE_T> queues(thread_count);
+    for (size_t i = 0; i < jobs.size(); i++) queues[i % thread_count].jobs.push_back(i);
+
+    const auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (size_t i = 0; i < thread_count; i++) workers.emplace_back(worker, &queues, &jobs, i);
+    for (thread &t : workers) t.join();
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Manifest order, whichever worker ran the job
+    int failed = 0;
+    uint64_t instructions = 0;
+    printf("# state            display            instructions  instr/s       quirks    frames  rom\n");
+    for (const JOB_T &job : jobs) {
+        if (!job.ok) {
+            printf("%-16s %-16s %13s %13s %-9s %7llu  %s\n", "FAILED", "-", "-", "-", job.quirks_name.c_str(),
+                   (unsigned long long)job.frames, job.rom.c_str());
+            failed++;
+            continue; }
+        printf("%016llX %016llX %13llu %13.0f %-9s %7llu  %s\n", (unsigned long long)job.state_hash,
+               (unsigned long long)job.display_hash, (unsigned long long)job.instructions,
+               job.seconds > 0 ? job.instructions / job.seconds : 0.0, job.quirks_name.c_str(),
+               (unsigned long long)job.frames, job.rom.c_str());
+        instructions += job.instructions;
+    }
+    fprintf(stderr, "%zu jobs on %zu threads in %.2f s, %.0f instructions/s overall, %d failed\n",
+            jobs.size(), thread_count, seconds, seconds > 0 ? instructions / seconds : 0.0, failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+// Vectorised environment on the lockstep engine; see chip8_env.h
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <SDL.h>
+#include "chip8_env.h"
+
+// Refresh one instance's watched RAM bytes
+static void read_watch(ENV_T *env, const uint32_t index) {
+    const LOCKSTEP_T<ENV_LANES> &group = env->groups[index / ENV_LANES];
+    ENV_OBSERVATION_T &observation = env->observations[index];
+    for (uint32_t i = 0; i < env->options.watch_count; i++)
+        observation.watch[i] = group.ram[env->options.watch[i] & 0xFFF][index % ENV_LANES];
+}
+
+bool env_init(ENV_T *env, const char rom_name[], const CONFIG_T &config, const ENV_OPTIONS_T &options, const uint32_t count) {
+    memset(env, 0, sizeof *env);
+    if (count == 0 || options.frames_per_step == 0 || options.watch_count > ENV_MAX_WATCH) {
+        SDL_Log("Environment needs at least one instance and one frame per step, and at most %d watched addresses\n", ENV_MAX_WATCH);
+        return false; }
+    if (config.current_ex != CHIP8) {
+        SDL_Log("Environment runs CHIP-8 quirks only\n");
+        return false; }
+
+    env->config = config;
+    env->options = options;
+    env->count = count;
+    env->group_count = (count + ENV_LANES - 1) / ENV_LANES;
+    env->groups = new (std::nothrow) LOCKSTEP_T<ENV_LANES>[env->group_count];
+    env->initial = (CHIP_8 *)calloc(1, sizeof(CHIP_8));
+    env->observations = new (std::nothrow) ENV_OBSERVATION_T[count]();
+    if (!env->groups || !env->initial || !env->observations || !init_chip8(env->initial, rom_name, CHIP8)) {
+        env_destroy(env);
+        return false; }
+
+    for (uint32_t g = 0; g < env->group_count; g++) lockstep_load_all(&env->groups[g], env->initial); // ROM read once
+    for (uint32_t i = 0; i < count; i++) {
+        env->observations[i].display = env->groups[i / ENV_LANES].display[i % ENV_LANES];
+        read_watch(env, i);
+    }
+    return true;
+}
+
+const ENV_OBSERVATION_T *env_step(ENV_T *env, const uint16_t *keypads) {
+    for (uint32_t i = 0; i < env->count; i++) env->groups[i / ENV_LANES].keypad[i % ENV_LANES] = keypads[i];
+
+    const uint64_t rate = env->config.clock_rate;
+    for (uint32_t f = 0; f < env->options.frames_per_step; f++, env->frame++) {
+        // Same instructions per frame as --headless and chip8-batch
+        const uint32_t instructions = (uint32_t)((env->frame + 1) * rate / 60 - env->frame * rate / 60);
+        for (uint32_t g = 0; g < env->group_count; g++) {
+            lockstep_run(&env->groups[g], env->config, instructions);
+            lockstep_update_timers(&env->groups[g]);
+        }
+    }
+
+    if (env->options.watch_count)
+        for (uint32_t i = 0; i < env->count; i++) read_watch(env, i);
+    return env->observations;
+}
+
+void env_reset(ENV_T *env, const uint32_t index) {
+    lockstep_load(&env->groups[index / ENV_LANES], index % ENV_LANES, env->initial);
+    read_watch(env, index);
+}
+
+void env_destroy(ENV_T *env) {
+    delete[] env->groups;
+    if (env->initial) destroy_chip8(env->initial);
+    free(env->initial);
+    delete[] env->observations;
+    memset(env, 0, sizeof *env);
+}
@@ -0,0 +1,46 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+// Vectorised environment: many instances of one ROM advanced together a step at a time, for search
+// and agent training. Instances run on the lockstep engine; observations point straight at each
+// instance's framebuffer, so a step neither allocates nor copies pixels. Those framebuffers are back to
+// back only within a group of ENV_LANES instances, not across the whole batch: gather them if one
+// contiguous tensor is needed. Build with the chip8-env library target (the emulator core without its main)
+
+#include "KOBZ_CHIP8PLUS.h"
+
+#define ENV_LANES 32            // Instances per lockstep group; the instance count is rounded up to a multiple
+#define ENV_MAX_WATCH 8         // RAM bytes reported per instance
+
+struct ENV_OPTIONS_T {
+    uint32_t frames_per_step;       // 60 Hz frames each env_step runs, at least 1
+    uint32_t watch_count;           // Entries used in watch
+    uint16_t watch[ENV_MAX_WATCH];  // RAM addresses read into every observation, e.g. score and lives
+};
+
+struct ENV_OBSERVATION_T {
+    const uint64_t *display;        // 32 packed rows of 64 pixels, pixel x of row y in bit 63 - x: the instance's own framebuffer, valid until env_destroy
+    uint8_t watch[ENV_MAX_WATCH];   // Bytes at ENV_OPTIONS_T::watch after the step
+};
+
+struct ENV_T {
+    CONFIG_T config;                // Clock rate and quirks shared by every instance
+    ENV_OPTIONS_T options;
+    uint32_t count;                 // Instances
+    uint32_t group_count;
+    LOCKSTEP_T<ENV_LANES> *groups;  // Instance i is lane i % ENV_LANES of group i / ENV_LANES
+    CHIP_8 *initial;                // The ROM as loaded, restored by env_reset
+    uint64_t frame;                 // Frames stepped so far; spreads clock_rate over 60 Hz frames
+    ENV_OBSERVATION_T *observations; // count entries, rewritten in place by every step
+};
+
+// Load rom_name into count instances. config supplies clock_rate and quirks (see set_config_from_args),
+// which must be CHIP-8's: the lockstep engine has no SUPER-CHIP mode
+bool env_init(ENV_T *env, const char rom_name[], const CONFIG_T &config, const ENV_OPTIONS_T &options, uint32_t count);
+// Hold keypads[i] (bit k = key k down) on instance i for frames_per_step frames. Returns env->observations
+const ENV_OBSERVATION_T *env_step(ENV_T *env, const uint16_t *keypads);
+// Restart one instance from the freshly loaded ROM, e.g. at the end of an episode
+void env_reset(ENV_T *env, uint32_t index);
+void env_destroy(ENV_T *env);
+
+#endif
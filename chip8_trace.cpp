@@ -0,0 +1,170 @@
+// chip8-trace: decoder for execution traces written by the emulator's --record option.
+//   chip8-trace dump <trace> [filters]    print the recorded instructions, oldest first
+//   chip8-trace diff <trace_a> <trace_b>  report where two runs first diverge
+// Filters: --pc <addr>[-<addr>], --op <name> (e.g. DXYN), --reg <V0-VF|I>, --from <n>, --to <n>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "KOBZ_CHIP8PLUS.h"
+using namespace std;
+
+static const char *const op_names[OP_COUNT] = {
+#define X(name) #name,
+    CHIP8_OPCODES(X)
+#undef X
+};
+
+struct FILTER_T {
+    uint32_t pc_lo, pc_hi;      // Inclusive PC range
+    int op;                     // OPCODE_T, or -1 for any
+    int reg;                    // RECORD_T::changed value, or -1 for any
+    uint64_t from, to;          // Inclusive instruction counter range
+};
+
+// Read a trace file; records come back in execution order, oldest first
+static bool load_trace(const char *path, vector<RECORD_T> *records) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        fprintf(stderr, "Could not open trace %s: %s\n", path, strerror(errno));
+        return false; }
+
+    RECORD_HEADER_T header;
+    if (fread(&header, sizeof header, 1, in) != 1 || header.magic != RECORD_MAGIC) {
+        fprintf(stderr, "%s is not a CHIP-8 trace\n", path);
+        fclose(in);
+        return false; }
+    if (header.version != RECORD_VERSION || header.record_size != sizeof(RECORD_T) || header.capacity == 0) {
+        fprintf(stderr, "%s: unsupported trace version %u\n", path, header.version);
+        fclose(in);
+        return false; }
+
+    vector<RECORD_T> ring(header.capacity);
+    const size_t stored = fread(ring.data(), sizeof(RECORD_T), ring.size(), in);
+    fclose(in);
+    const uint64_t count = header.total < header.capacity ? header.total : header.capacity;
+    if (stored < count) {
+        fprintf(stderr, "%s is truncated\n", path);
+        return false; }
+
+    // Once the ring has wrapped the oldest record sits right after the newest
+    const uint64_t oldest = header.total > header.capacity ? header.total % header.capacity : 0;
+    records->clear();
+    for (uint64_t i = 0; i < count; i++) records->push_back(ring[(oldest + i) % header.capacity]);
+    return true;
+}
+
+static void print_record(const RECORD_T &record) {
+    const OPCODE_T op = decode_opcode(decode_operands(record.opcode));
+    printf("%10llu  %03X  %04X  ", (unsigned long long)record.counter, record.PC, record.opcode);
+    if (record.changed == RECORD_I) printf("%-7s  I=%03X\n", op_names[op], record.value);
+    else if (record.changed != RECORD_NONE) printf("%-7s  V%X=%02X\n", op_names[op], record.changed, record.value);
+    else printf("%s\n", op_names[op]);
+}
+
+static bool matches(const FILTER_T &filter, const RECORD_T &record) {
+    if (record.PC < filter.pc_lo || record.PC > filter.pc_hi) return false;
+    if (record.counter < filter.from || record.counter > filter.to) return false;
+    if (filter.op >= 0 && decode_opcode(decode_operands(record.opcode)) != filter.op) return false;
+    if (filter.reg >= 0 && record.changed != filter.reg) return false;
+    return true;
+}
+
+// Opcode name as printed by dump, e.g. DXYN; case-insensitive
+static int parse_op(const char *name) {
+    for (int op = 0; op < OP_COUNT; op++) {
+        size_t i = 0;
+        while (name[i] && op_names[op][i] && toupper((unsigned char)name[i]) == toupper((unsigned char)op_names[op][i])) i++;
+        if (!name[i] && !op_names[op][i]) return op;
+    }
+    return -1;
+}
+
+// V0-VF or I
+static int parse_reg(const char *name) {
+    if (toupper((unsigned char)name[0]) == 'I' && !name[1]) return RECORD_I;
+    if (toupper((unsigned char)name[0]) == 'V' && isxdigit((unsigned char)name[1]) && !name[2])
+        return (int)strtol(&name[1], nullptr, 16);
+    return -1;
+}
+
+static int dump(const char *path, const FILTER_T &filter) {
+    vector<RECORD_T> records;
+    if (!load_trace(path, &records)) return EXIT_FAILURE;
+    for (const RECORD_T &record : records)
+        if (matches(filter, record)) print_record(record);
+    return EXIT_SUCCESS;
+}
+
+// First instruction counter both traces cover where they disagree; exit status 1 if there is one
+static int diff(const char *path_a, const char *path_b, const FILTER_T &filter) {
+    vector<RECORD_T> a, b;
+    if (!load_trace(path_a, &a) || !load_trace(path_b, &b)) return 2;
+    if (a.empty() || b.empty()) {
+        printf("Nothing to compare\n");
+        return EXIT_SUCCESS; }
+
+    // Align on the instruction counter: rings may have wrapped at different points
+    size_t i = 0, j = 0;
+    while (i < a.size() && a[i].counter < b[0].counter) i++;
+    while (j < b.size() && b[j].counter < a[0].counter) j++;
+    if (i == a.size() || j == b.size()) {
+        printf("Traces do not overlap (%s: %llu-%llu, %s: %llu-%llu)\n",
+               path_a, (unsigned long long)a.front().counter, (unsigned long long)a.back().counter,
+               path_b, (unsigned long long)b.front().counter, (unsigned long long)b.back().counter);
+        return EXIT_SUCCESS; }
+
+    const size_t start_a = i;
+    for (; i < a.size() && j < b.size(); i++, j++) {
+        if (a[i].counter > filter.to) break;
+        if (a[i].PC == b[j].PC && a[i].opcode == b[j].opcode && a[i].changed == b[j].changed && a[i].value == b[j].value)
+            continue;
+
+        printf("Traces diverge at instruction %llu\n", (unsigned long long)a[i].counter);
+        for (size_t k = i > start_a + 5 ? i - 5 : start_a; k < i; k++) { printf("   "); print_record(a[k]); }
+        printf("a: "); print_record(a[i]);
+        printf("b: "); print_record(b[j]);
+        return 1;
+    }
+    printf("Traces match over %zu instructions\n", i - start_a);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    const bool is_diff = argc >= 4 && strcmp(argv[1], "diff") == 0;
+    if (argc < 3 || (!is_diff && strcmp(argv[1], "dump") != 0)) {
+        fprintf(stderr, "Usage: %s dump <trace> [--pc <addr>[-<addr>]] [--op <name>] [--reg <V0-VF|I>] [--from <n>] [--to <n>]\n"
+                        "       %s diff <trace_a> <trace_b> [--to <n>]\n", argv[0], argv[0]);
+        exit(EXIT_FAILURE); }
+
+    FILTER_T filter = {0, 0xFFFF, -1, -1, 0, UINT64_MAX};
+    for (int i = is_diff ? 4 : 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            exit(EXIT_FAILURE); }
+        const char *value = argv[++i];
+        if (strcmp(argv[i - 1], "--pc") == 0) {
+            char *end;
+            filter.pc_lo = (uint32_t)strtoul(value, &end, 16);
+            filter.pc_hi = *end == '-' ? (uint32_t)strtoul(end + 1, nullptr, 16) : filter.pc_lo;
+        } else if (strcmp(argv[i - 1], "--op") == 0) {
+            if ((filter.op = parse_op(value)) < 0) {
+                fprintf(stderr, "Unknown opcode %s\n", value);
+                exit(EXIT_FAILURE); }
+        } else if (strcmp(argv[i - 1], "--reg") == 0) {
+            if ((filter.reg = parse_reg(value)) < 0) {
+                fprintf(stderr, "Unknown register %s (expected V0-VF or I)\n", value);
+                exit(EXIT_FAILURE); }
+        } else if (strcmp(argv[i - 1], "--from") == 0) {
+            filter.from = strtoull(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--to") == 0) {
+            filter.to = strtoull(value, nullptr, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i - 1]);
+            exit(EXIT_FAILURE); }
+    }
+
+    return is_diff ? diff(argv[2], argv[3], filter) : dump(argv[2], filter);
+}
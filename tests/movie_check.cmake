@@ -0,0 +1,29 @@
+# Movie pacing check, run by ctest through chip8_add_movie_test:
+#   cmake -DEMULATOR=<exe> -DROM=<rom> -DNAME=<test> -DFRAMES=<n> -P movie_check.cmake
+# Records ROM for FRAMES frames in one pacing mode and plays the movie back in another: windowed real
+# time to headless, headless to windowed real time, and windowed fast-forward to headless. The
+# emulator exits with status 1 when a played movie desyncs. Windowed runs need a video driver; ctest
+# sets SDL's dummy drivers
+
+foreach(variable EMULATOR ROM NAME FRAMES)
+    if(NOT DEFINED ${variable})
+        message(FATAL_ERROR "movie_check.cmake needs -D${variable}")
+    endif()
+endforeach()
+
+# Run the ROM with the given options; what describes the run in a failure
+function(run_rom what)
+    execute_process(COMMAND "${EMULATOR}" "${ROM}" ${ARGN} RESULT_VARIABLE status OUTPUT_QUIET)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "${what}: ${EMULATOR} exited with ${status}")
+    endif()
+endfunction()
+
+run_rom("windowed recording" --max-frames ${FRAMES} --movie-record ${NAME}_window.mv)
+run_rom("headless playback of the windowed recording" --headless --movie-play ${NAME}_window.mv)
+
+run_rom("headless recording" --headless --max-frames ${FRAMES} --movie-record ${NAME}_headless.mv)
+run_rom("windowed playback of the headless recording" --max-frames ${FRAMES} --movie-play ${NAME}_headless.mv)
+
+run_rom("fast-forward recording" --turbo --max-frames ${FRAMES} --movie-record ${NAME}_turbo.mv)
+run_rom("headless playback of the fast-forward recording" --headless --movie-play ${NAME}_turbo.mv)
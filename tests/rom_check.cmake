@@ -0,0 +1,59 @@
+# ROM regression check, run by ctest through chip8_add_rom_test:
+#   cmake -DEMULATOR=<exe> -DROM=<rom> -DNAME=<test> -DFRAMES=<n> -DQUIRKS=<chip8|superchip|xochip>
+#         -DENGINES=<engine,...> [-DAOT_EMULATOR=<exe>] [-DDISPLAY_HASH=<hex>] -P rom_check.cmake
+# Runs ROM headless for FRAMES frames on each engine, then again on each engine in two halves joined by
+# --save-state and --load-state. Every run must end in the same machine state (registers, stack,
+# display hash and RAM), and with the display hashing to DISPLAY_HASH if given. The aot engine runs on
+# AOT_EMULATOR, a build with ROM precompiled in
+
+foreach(variable EMULATOR ROM NAME FRAMES QUIRKS ENGINES)
+    if(NOT DEFINED ${variable})
+        message(FATAL_ERROR "rom_check.cmake needs -D${variable}")
+    endif()
+endforeach()
+string(REPLACE "," ";" ENGINES "${ENGINES}")
+math(EXPR half "${FRAMES} / 120 * 60") # Whole seconds, so both halves split clock_rate / 60 the same way
+if(half EQUAL 0)
+    message(FATAL_ERROR "FRAMES must be at least 120 for the save state round trip")
+endif()
+math(EXPR rest "${FRAMES} - ${half}")
+
+# Run the ROM headless on engine for frames frames, leaving the dump minus its counters in state.
+# Extra arguments go to the emulator
+function(run_rom engine frames out)
+    set(emulator "${EMULATOR}")
+    if(engine STREQUAL "aot" AND AOT_EMULATOR)
+        set(emulator "${AOT_EMULATOR}")
+    endif()
+    execute_process(COMMAND "${emulator}" "${ROM}" --headless --quirks ${QUIRKS} --engine ${engine}
+            --max-frames ${frames} --dump "${out}" ${ARGN}
+            RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "${engine}: ${emulator} exited with ${status}")
+    endif()
+    file(READ "${out}" dump)
+    string(REGEX REPLACE "^.*\nframes: [0-9]+\n" "" dump "${dump}") # A resumed run counts from the state
+    set(state "${dump}" PARENT_SCOPE)
+endfunction()
+
+unset(reference)
+foreach(engine IN LISTS ENGINES)
+    run_rom(${engine} ${FRAMES} ${NAME}_${engine}.txt)
+    if(NOT DEFINED reference)
+        set(reference "${state}")
+        set(reference_name ${NAME}_${engine}.txt)
+    elseif(NOT state STREQUAL reference)
+        message(FATAL_ERROR "${engine} ends in a different state: compare ${NAME}_${engine}.txt with ${reference_name}")
+    endif()
+
+    run_rom(${engine} ${half} ${NAME}_${engine}_half.txt --save-state ${NAME}_${engine}.state)
+    run_rom(${engine} ${rest} ${NAME}_${engine}_resumed.txt --load-state ${NAME}_${engine}.state)
+    if(NOT state STREQUAL reference)
+        message(FATAL_ERROR "${engine} ends in a different state after a save state at frame ${half}: "
+                "compare ${NAME}_${engine}_resumed.txt with ${reference_name}")
+    endif()
+endforeach()
+
+if(DISPLAY_HASH AND NOT reference MATCHES "\ndisplay: ${DISPLAY_HASH}\n")
+    message(FATAL_ERROR "Display does not hash to ${DISPLAY_HASH}: see ${reference_name}")
+endif()